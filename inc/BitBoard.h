@@ -2,6 +2,8 @@
 #define BITBOARD_H
 
 #include "globals.h"
+#include "MoveList.h"
+#include "Zobrist.h"
 
 constexpr uint8_t ALL = 0;
 constexpr uint8_t PAWN = 1;
@@ -47,6 +49,55 @@ constexpr uint64_t BK_MASK = 0x60;
 constexpr uint64_t BQ_MASK = 0xe;
 constexpr uint64_t BQ_ATTACK_MASK = 0xc;
 
+/* Key of a piece on a square. Polyglot counts ranks from the bottom and puts black before white for each piece type */
+constexpr uint64_t zobrist_piece(uint8_t color, uint8_t piece, uint8_t square)
+{
+    return ZOBRIST_KEYS[64 * ((piece - 1) * 2 + (color == WHITE)) + 8 * (7 - square / 8) + (square % 8)];
+}
+
+/* Key of every combination of castling rights, indexed by the WQ | WK | BQ | BK flags */
+constexpr std::array<uint64_t, 16> generate_zobrist_castling()
+{
+    std::array<uint64_t, 16> keys = {};
+    for (int rights = 0; rights < 16; rights++)
+    {
+        keys[rights] = ((rights & WK) ? ZOBRIST_KEYS[768] : 0) ^ ((rights & WQ) ? ZOBRIST_KEYS[769] : 0)
+                     ^ ((rights & BK) ? ZOBRIST_KEYS[770] : 0) ^ ((rights & BQ) ? ZOBRIST_KEYS[771] : 0);
+    }
+    return keys;
+}
+
+constexpr std::array<uint64_t, 16> ZOBRIST_CASTLING = generate_zobrist_castling();
+constexpr uint64_t ZOBRIST_WHITE_TO_MOVE = ZOBRIST_KEYS[780];
+
+// Kind of moves a generator produces. GEN_EVASIONS is every legal move when in check.
+enum GenType
+{
+    GEN_ALL,
+    GEN_CAPTURES,
+    GEN_QUIETS,
+    GEN_EVASIONS
+};
+
+/* Moves of a whole set of pawns at once, going up the board for white and down for black */
+template <uint8_t Color>
+constexpr uint64_t pawn_push(uint64_t pawns)
+{
+    return Color == WHITE ? pawns >> 8 : pawns << 8;
+}
+
+template <uint8_t Color>
+constexpr uint64_t pawn_attacks_west(uint64_t pawns)
+{
+    return Color == WHITE ? (pawns & ~FILE_A) >> 9 : (pawns & ~FILE_A) << 7;
+}
+
+template <uint8_t Color>
+constexpr uint64_t pawn_attacks_east(uint64_t pawns)
+{
+    return Color == WHITE ? (pawns & ~FILE_H) >> 7 : (pawns & ~FILE_H) << 9;
+}
+
 constexpr std::array<uint64_t, 64> KNIGHT_MOVES =
 {
     132096ULL, 329728ULL, 659712ULL, 1319424ULL, 2638848ULL, 5277696ULL, 10489856ULL, 4202496ULL,
@@ -108,7 +159,7 @@ constexpr std::array<uint64_t, 64> ROOK_MAGICS = {
     0x1001040311802142ULL,
 };
 
-const std::array<uint64_t, 64> BISHOP_MAGICS = {
+constexpr std::array<uint64_t, 64> BISHOP_MAGICS = {
     0x1024b002420160ULL, 0x1008080140420021ULL, 0x2012080041080024ULL, 0xc282601408c0802ULL, 0x2004042000000002ULL, 0x12021004022080ULL, 0x880414820100000ULL, 0x4501002211044000ULL,
     0x20402222121600ULL, 0x1081088a28022020ULL, 0x1004c2810851064ULL, 0x2040080841004918ULL, 0x1448020210201017ULL, 0x4808110108400025ULL, 0x10504404054004ULL, 0x800010422092400ULL,
     0x40000870450250ULL, 0x402040408080518ULL, 0x1000980a404108ULL, 0x1020804110080ULL, 0x8200c02082005ULL, 0x40802009a0800ULL, 0x1000201012100ULL, 0x111080200820180ULL,
@@ -119,7 +170,7 @@ const std::array<uint64_t, 64> BISHOP_MAGICS = {
     0x8060104054400ULL, 0x20004404020a0a01ULL, 0x40008010020214ULL, 0x4000050209802c1ULL, 0x208244210400ULL, 0x10140848044010ULL,
 };
 
-const std::array<int, 64> ROOK_SHIFTS = {
+constexpr std::array<int, 64> ROOK_SHIFTS = {
     12, 11, 11, 11, 11, 11, 11, 12, 
     11, 10, 10, 10, 10, 10, 10, 11,
     11, 10, 10, 10, 10, 10, 10, 11,
@@ -130,7 +181,7 @@ const std::array<int, 64> ROOK_SHIFTS = {
     12, 11, 11, 11, 11, 11, 11, 12
 };
 
-const std::array<int, 64> BISHOP_SHIFTS = {
+constexpr std::array<int, 64> BISHOP_SHIFTS = {
     6, 5, 5, 5, 5, 5, 5, 6,
     5, 5, 5, 5, 5, 5, 5, 5,
     5, 5, 7, 7, 7, 7, 5, 5,
@@ -141,69 +192,157 @@ const std::array<int, 64> BISHOP_SHIFTS = {
     6, 5, 5, 5, 5, 5, 5, 6
 };
 
+/* Squares strictly between two squares sharing a rank, file or diagonal, empty for any other pair */
+constexpr std::array<std::array<uint64_t, 64>, 64> generate_between()
+{
+    std::array<std::array<uint64_t, 64>, 64> between = {};
+    for (int from = 0; from < 64; from++)
+    {
+        for (int to = 0; to < 64; to++)
+        {
+            int x_diff = to % 8 - from % 8;
+            int y_diff = to / 8 - from / 8;
+            if (from == to || (x_diff != 0 && y_diff != 0 && x_diff != y_diff && x_diff != -y_diff))
+                continue;
+            int step = ((y_diff > 0) - (y_diff < 0)) * 8 + (x_diff > 0) - (x_diff < 0);
+            for (int at = from + step; at != to; at += step)
+                between[from][to] |= (1ULL << at);
+        }
+    }
+    return between;
+}
+
+/* Whole rank, file or diagonal going through two squares (edge to edge, both included), empty if they are not aligned */
+constexpr std::array<std::array<uint64_t, 64>, 64> generate_line()
+{
+    std::array<std::array<uint64_t, 64>, 64> line = {};
+    for (int from = 0; from < 64; from++)
+    {
+        for (int to = 0; to < 64; to++)
+        {
+            int x_diff = to % 8 - from % 8;
+            int y_diff = to / 8 - from / 8;
+            if (from == to || (x_diff != 0 && y_diff != 0 && x_diff != y_diff && x_diff != -y_diff))
+                continue;
+            int x_step = (x_diff > 0) - (x_diff < 0);
+            int y_step = (y_diff > 0) - (y_diff < 0);
+            for (int direction : { 1, -1 })
+            {
+                for (int x = from % 8, y = from / 8; x >= 0 && x < 8 && y >= 0 && y < 8; x += x_step * direction, y += y_step * direction)
+                    line[from][to] |= (1ULL << (y * 8 + x));
+            }
+        }
+    }
+    return line;
+}
+
+constexpr std::array<std::array<uint64_t, 64>, 64> BETWEEN = generate_between();
+constexpr std::array<std::array<uint64_t, 64>, 64> LINE = generate_line();
+
+/* Start of each square's slice in a flat attack table, a square only needs 2^shift keys */
+constexpr std::array<uint32_t, 65> slider_offsets(const std::array<int, 64>& shifts)
+{
+    std::array<uint32_t, 65> offsets = {};
+    for (int square = 0; square < 64; square++)
+        offsets[square + 1] = offsets[square] + (1U << shifts[square]);
+    return offsets;
+}
+
+constexpr std::array<uint32_t, 65> ROOK_OFFSETS = slider_offsets(ROOK_SHIFTS);
+constexpr std::array<uint32_t, 65> BISHOP_OFFSETS = slider_offsets(BISHOP_SHIFTS);
+
+// How a blocker board is turned into an index of the attack tables: multiply-shift magics work everywhere,
+// BMI2 PEXT extracts the relevant bits directly and is picked at startup when the CPU runs it fast.
+enum SliderBackend
+{
+    MAGIC_BACKEND,
+    PEXT_BACKEND
+};
+
+extern SliderBackend slider_backend;
+
+// Slider attacks for every square and every relevant blocker board, indexed by OFFSETS[square] + backend key.
+// Shared by every board and search thread, they are filled once at startup.
+alignas(64) extern std::array<uint64_t, ROOK_OFFSETS[64]> ROOK_ATTACKS;
+alignas(64) extern std::array<uint64_t, BISHOP_OFFSETS[64]> BISHOP_ATTACKS;
+
 class BitBoard
 {
     public:
-        // 4096 because the maximum amount of relevant squares for a rook is 12, so that makes 2^12 = 4096 possible keys
-        std::vector<std::vector<uint64_t>> rook_moves;
-        // 512 because the maximum amount of relevant squares for a bishop is 9, so that makes 2^9 = 512 possible keys
-        std::vector<std::vector<uint64_t>> bishop_moves;
-    
         std::array<std::array<uint64_t, 7>, 2> m_bitboards;
         std::array<uint8_t, 64> m_pieces;
+        uint64_t m_key;
         uint8_t m_player_to_move;
         uint8_t m_castling_rights;
         uint8_t m_en_passant_square;
         uint8_t m_last_move_to;
-
-        bool m_check;
+        // Plies since the last capture or pawn move: the fifty-move rule, and how far back a repetition can be
+        uint8_t m_halfmove_clock;
 
     public:
         BitBoard();
-        BitBoard(const BitBoard& other);
         BitBoard(const std::string& pgn);
-        BitBoard& operator=(const BitBoard& other);
 
         uint64_t pieceBoard(uint8_t color, uint8_t piece) const;
         uint64_t colorBoard(uint8_t color) const;
         uint64_t allPieces() const;
         uint64_t squareAttackers(uint8_t square, uint8_t attacker_color) const;
-        uint64_t create_ray(uint8_t from, uint8_t to) const;
+        uint64_t attackersTo(uint8_t square, uint64_t occupancy) const;
 
         std::vector<uint16_t> get_moves(uint8_t color) const;
         std::vector<uint16_t> get_capture_moves(uint8_t color) const;
+        void get_moves(uint8_t color, MoveList& moves) const;
+        void get_capture_moves(uint8_t color, MoveList& moves) const;
+        void get_quiet_moves(uint8_t color, MoveList& moves) const;
         uint64_t get_bishop_moves(uint8_t square, uint64_t blockers) const;
         uint64_t get_rook_moves(uint8_t square, uint64_t blockers) const;
-        uint64_t get_pawn_moves(uint8_t square) const;
         uint8_t player_to_move() const;
         bool isSquareAttacked(uint8_t square, uint8_t attacker_color) const;
         bool isCapture(uint16_t move) const;
+        bool isLegal(uint16_t move) const;
         uint64_t xrayRookAttacks(uint64_t blockers, uint8_t square) const;
         uint64_t xrayBishopAttacks(uint64_t blockers, uint8_t square) const;
         uint64_t get_attack_mask(uint8_t color) const;
 
-        void generate_bishop_moves();
-        void generate_rook_moves();
-
         bool occupied(uint8_t bit) const;
         uint8_t at(uint8_t bit) const;
         void setPiece(uint8_t color, uint8_t piece, uint8_t bit);
+        void removePiece(uint8_t color, uint8_t piece, uint8_t bit);
         uint64_t movePiece(int8_t from, int8_t to, uint8_t promotion_piece);
         void undoMove(uint64_t move);
+        uint64_t makeNullMove();
+        void undoNullMove(uint64_t move);
 
+        uint64_t computeKey() const;
         bool isCorrupted() const;
 
         friend std::ostream& operator<<(std::ostream& os, const BitBoard& board);
+
+    private:
+        template <uint8_t Color, GenType Type>
+        void generate_moves(MoveList& moves, uint64_t checkers) const;
+        template <uint8_t Color>
+        uint64_t attack_mask() const;
+        uint64_t en_passant_key() const;
 };
 
+// The board is the whole position and nothing else, so it can be copied with a plain memcpy (copy-make search)
+static_assert(std::is_trivially_copyable<BitBoard>::value, "BitBoard must stay trivially copyable");
+static_assert(sizeof(BitBoard) <= 192, "BitBoard must stay small enough to be copied at every ply");
+
 std::ostream& operator<<(std::ostream& os, const BitBoard& board);
 
 void printBitboard(uint64_t bitboard);
+std::string move_to_string(uint16_t move);
 void precomputed_knight_moves();
 void precomputed_king_moves();
 uint64_t generate_blockerboard_with_index(int index, uint64_t blockermask);
 void rook_relevant_masks();
 void bishop_relevant_masks();
+void generate_bishop_moves();
+void generate_rook_moves();
+SliderBackend detect_slider_backend();
+bool set_slider_backend(SliderBackend backend);
 uint8_t countBits(uint64_t n);
 
 
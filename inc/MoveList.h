@@ -0,0 +1,31 @@
+#ifndef MOVE_LIST_H
+#define MOVE_LIST_H
+
+#include "globals.h"
+
+// Fixed capacity move list living on the stack of its caller, so generating moves never allocates.
+// No legal chess position has more than 218 moves.
+class MoveList
+{
+    private:
+        std::array<uint16_t, 256> m_moves;
+        size_t m_size;
+
+    public:
+        MoveList() : m_size(0) {}
+
+        void push_back(uint16_t move) { m_moves[m_size++] = move; }
+        void clear() { m_size = 0; }
+        size_t size() const { return m_size; }
+        bool empty() const { return m_size == 0; }
+
+        uint16_t& operator[](size_t index) { return m_moves[index]; }
+        uint16_t operator[](size_t index) const { return m_moves[index]; }
+
+        uint16_t* begin() { return m_moves.data(); }
+        uint16_t* end() { return m_moves.data() + m_size; }
+        const uint16_t* begin() const { return m_moves.data(); }
+        const uint16_t* end() const { return m_moves.data() + m_size; }
+};
+
+#endif
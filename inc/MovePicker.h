@@ -0,0 +1,58 @@
+#ifndef MOVE_PICKER_H
+#define MOVE_PICKER_H
+
+#include "globals.h"
+#include "BitBoard.h"
+#include "MoveList.h"
+
+// Butterfly history of the quiet moves, indexed by [color][from][to]: raised when a move causes a cutoff,
+// lowered when it was tried before the one that did
+using HistoryTable = std::array<std::array<std::array<int16_t, 64>, 64>, 2>;
+constexpr int MAX_HISTORY = 16384;
+
+// Hands out the moves of a position one at a time, best first, generating each kind of move only when it is needed.
+// A beta cutoff on the transposition table move or on a capture never pays for the quiet moves generation.
+// Captures losing material by static exchange come after the quiet moves, and are not handed out at all in quiescence.
+enum MovePickerStage
+{
+    TT_MOVE_STAGE,
+    GENERATE_CAPTURES_STAGE,
+    GOOD_CAPTURES_STAGE,
+    KILLERS_STAGE,
+    GENERATE_QUIETS_STAGE,
+    QUIETS_STAGE,
+    BAD_CAPTURES_STAGE,
+    DONE_STAGE
+};
+
+class MovePicker
+{
+    private:
+        const BitBoard& m_board;
+        uint16_t m_ttMove;
+        // Quiet moves that refuted a sibling position: the two killers and the countermove of the previous move
+        std::array<uint16_t, 3> m_refutations;
+        const HistoryTable* m_history;
+        bool m_capturesOnly;
+        uint8_t m_stage;
+        MoveList m_moves;
+        std::array<int, 256> m_scores;
+        size_t m_index;
+        MoveList m_badCaptures;
+
+    public:
+        MovePicker(const BitBoard& board, uint16_t ttMove, const std::array<uint16_t, 2>& killers, uint16_t counterMove, const HistoryTable& history);
+        MovePicker(const BitBoard& board, uint16_t ttMove);
+
+        uint16_t next();
+
+    private:
+        void scoreCaptures();
+        void scoreQuiets();
+        uint16_t pickBest();
+        bool isBadCapture(uint16_t move) const;
+};
+
+int see(const BitBoard& board, uint16_t move);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef TIME_MANAGER_H
+#define TIME_MANAGER_H
+
+#include "globals.h"
+
+// Milliseconds kept aside for each move to reach the clock (GUI, network), never planned for the search
+constexpr uint64_t MOVE_OVERHEAD = 30;
+// Moves the remaining time is shared between when the time control does not say
+constexpr uint16_t DEFAULT_MOVES_TO_GO = 30;
+
+// State of the clock of the side to move, in milliseconds. timeLeft 0 means the game is not played on a clock.
+struct TimeControl
+{
+    uint64_t timeLeft;
+    uint64_t increment;
+    uint16_t movesToGo; // 0 for sudden death
+};
+
+// Decides how long a search runs. The soft limit is the time normally spent on a move, checked between
+// iterations and stretched or shortened by how the iterations go. The hard limit aborts the search wherever it is.
+class TimeManager
+{
+    private:
+        std::chrono::steady_clock::time_point m_start;
+        uint64_t m_softLimit;
+        uint64_t m_hardLimit;
+        bool m_fixed;
+        uint16_t m_bestMove;
+        int m_score;
+        uint8_t m_stableIterations;
+        double m_instability;
+
+    public:
+        TimeManager();
+
+        void start(const TimeControl& timeControl);
+        void start(uint64_t moveTime);
+
+        uint64_t elapsed() const;
+        bool hardLimitReached() const;
+        bool stopAfterIteration(uint16_t bestMove, int score);
+
+    private:
+        void reset();
+};
+
+#endif
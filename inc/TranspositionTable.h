@@ -0,0 +1,72 @@
+#ifndef TRANSPOSITION_TABLE_H
+#define TRANSPOSITION_TABLE_H
+
+#include "globals.h"
+
+constexpr size_t DEFAULT_HASH_MB = 16;
+
+enum TranspositionTableNodeType
+{
+    EXACT,
+    UPPERBOUND,
+    LOWERBOUND
+};
+
+// What a probe hands back to the search
+struct TranspositionTableData
+{
+    uint16_t move;
+    uint8_t depth;
+    int score;
+    TranspositionTableNodeType type;
+};
+
+// Entry shared by every search thread without locks: data packs move | score << 16 | depth << 32 | type << 40 | generation << 42
+// and the key is stored XORed with it. An entry torn by two threads writing at once no longer matches its key and is a miss.
+// The depth is stored plus one so that 0 marks an empty slot, quiescence nodes are stored with depth 0.
+struct TranspositionTableEntry
+{
+    std::atomic<uint64_t> key_xor_data;
+    std::atomic<uint64_t> data;
+};
+
+constexpr size_t TT_BUCKET_SIZE = 4;
+
+// One cache line, a probe only ever touches this
+struct alignas(64) TranspositionTableBucket
+{
+    std::array<TranspositionTableEntry, TT_BUCKET_SIZE> entries;
+};
+
+static_assert(sizeof(TranspositionTableBucket) == 64, "A transposition table bucket must fill exactly one cache line");
+
+// Fixed size hash table of the search results, shared by all the search threads, sized in megabytes and rounded down to a power of two buckets.
+// When a bucket is full, the shallowest entry left by the oldest search is replaced. Entries are never swept:
+// bumping the generation at each search is all it takes to age the whole table.
+class TranspositionTable
+{
+    private:
+        std::unique_ptr<TranspositionTableBucket[]> m_buckets;
+        uint64_t m_mask;
+        uint8_t m_generation;
+
+    public:
+        TranspositionTable(size_t megabytes = DEFAULT_HASH_MB);
+        TranspositionTable(const TranspositionTable& other);
+        TranspositionTable& operator=(const TranspositionTable& other);
+
+        void resize(size_t megabytes);
+        void clear();
+        void newSearch();
+
+        bool probe(uint64_t key, TranspositionTableData& data) const;
+        void store(uint64_t key, uint16_t move, uint8_t depth, int score, TranspositionTableNodeType type);
+
+        size_t size() const;
+        int hashfull() const;
+
+    private:
+        uint8_t age(uint64_t data) const;
+};
+
+#endif
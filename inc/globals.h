@@ -17,6 +17,11 @@
 #include <chrono>
 #include <memory>
 #include <cstring>
+#include <type_traits>
+#include <cassert>
+#include <atomic>
+#include <thread>
+#include <cmath>
 
 #ifdef CHESS_GUI
 #include <SFML/Window.hpp>
@@ -1,43 +1,67 @@
 #include "BitBoard.h"
 
+#ifdef __x86_64__
+#include <immintrin.h>
+#include <cpuid.h>
+#define CHESS_HAS_PEXT
+#endif
+
 /* -------------------------------------------------------------------------- */
 /*                               BitBoard class                               */
 /* -------------------------------------------------------------------------- */
 
+alignas(64) std::array<uint64_t, ROOK_OFFSETS[64]> ROOK_ATTACKS;
+alignas(64) std::array<uint64_t, BISHOP_OFFSETS[64]> BISHOP_ATTACKS;
+
+SliderBackend slider_backend = MAGIC_BACKEND;
+
+#ifdef CHESS_HAS_PEXT
+__attribute__((target("bmi2"))) static inline uint64_t pext(uint64_t bits, uint64_t mask)
+{
+    return _pext_u64(bits, mask);
+}
+#endif
+
+/* Index of the blocker board in a square's slice of the rook table, for the current backend */
+static inline uint64_t rook_key(uint8_t square, uint64_t blockers)
+{
+#ifdef CHESS_HAS_PEXT
+    if (slider_backend == PEXT_BACKEND)
+        return pext(blockers, ROOK_RELEVANT_MASKS[square]);
+#endif
+    return ((blockers & ROOK_RELEVANT_MASKS[square]) * ROOK_MAGICS[square]) >> (64 - ROOK_SHIFTS[square]);
+}
+
+/* Index of the blocker board in a square's slice of the bishop table, for the current backend */
+static inline uint64_t bishop_key(uint8_t square, uint64_t blockers)
+{
+#ifdef CHESS_HAS_PEXT
+    if (slider_backend == PEXT_BACKEND)
+        return pext(blockers, BISHOP_RELEVANT_MASKS[square]);
+#endif
+    return ((blockers & BISHOP_RELEVANT_MASKS[square]) * BISHOP_MAGICS[square]) >> (64 - BISHOP_SHIFTS[square]);
+}
+
+static const bool slider_attacks_generated = set_slider_backend(detect_slider_backend());
+
 BitBoard::BitBoard() {
-    rook_moves.assign(64, {});
-    for (auto& elem : rook_moves)
-        elem.assign(4096, 0);
-    bishop_moves.assign(64, {});
-    for (auto& elem : bishop_moves)
-        elem.assign(512, 0);
     for (auto& elem : m_bitboards)
         elem.fill(0);
     m_pieces.fill(0);
+    m_player_to_move = WHITE;
     m_castling_rights = 0;
+    m_en_passant_square = 255;
     m_last_move_to = 64;
-    generate_rook_moves();
-    generate_bishop_moves();
-}
-
-BitBoard::BitBoard(const BitBoard& other)
-{
-    *this = other;
+    m_halfmove_clock = 0;
+    m_key = computeKey();
 }
 
 BitBoard::BitBoard(const std::string& fen)
 {
-    rook_moves.assign(64, {});
-    for (auto& elem : rook_moves)
-        elem.assign(4096, 0);
-    bishop_moves.assign(64, {});
-    for (auto& elem : bishop_moves)
-        elem.assign(512, 0);
     for (auto& elem : m_bitboards)
         elem.fill(0);
     m_pieces.fill(0);
-    generate_rook_moves();
-    generate_bishop_moves();
+    m_key = 0;
 
     int8_t x = 0;
     int8_t y = 0;
@@ -113,7 +137,10 @@ BitBoard::BitBoard(const std::string& fen)
     }
     index++;
     m_en_passant_square = fen[index] == '-' ? 255 : fen[index] - 'a' + (m_player_to_move == WHITE ? 2 : 5) * 8;
+    index += fen[index] == '-' ? 2 : 3;
+    m_halfmove_clock = index < static_cast<int>(fen.size()) ? std::min(std::atoi(fen.c_str() + index), 255) : 0;
     m_last_move_to = 64;
+    m_key = computeKey();
 }
 
 uint8_t BitBoard::player_to_move() const
@@ -132,7 +159,9 @@ uint64_t BitBoard::movePiece(int8_t from, int8_t to, uint8_t promotion_piece)
     uint8_t captured_color = m_bitboards[WHITE][ALL] & (1ULL << captured_pos) ? WHITE : BLACK;
     uint64_t encodedMove = (to & 0b111111) | (from << 6) | (captured << 12) | (captured_color << 15)
                         | (captured_pos << 16) | (static_cast<uint64_t>(m_en_passant_square) << 22) | ((static_cast<uint64_t>(m_castling_rights)) << 30)
-                        | (static_cast<uint64_t>(piece) << 34) | (static_cast<uint64_t>(m_last_move_to) << 37);
+                        | (static_cast<uint64_t>(piece) << 34) | (static_cast<uint64_t>(m_last_move_to) << 37) | (static_cast<uint64_t>(m_halfmove_clock) << 44);
+
+    m_key ^= ZOBRIST_CASTLING[m_castling_rights] ^ en_passant_key();
 
     if (piece == KING)
         m_castling_rights &= ~((WK | WQ) << (color * 2));
@@ -150,17 +179,13 @@ uint64_t BitBoard::movePiece(int8_t from, int8_t to, uint8_t promotion_piece)
         if (to - from > 0)
         {
             // Move rook to F file
-            m_bitboards[color][ALL] ^= (1ULL << (y * 8 + 7));
-            m_bitboards[color][ROOK] ^= (1ULL << (y * 8 + 7));
-            m_pieces[y * 8 + 7] = 0;
+            removePiece(color, ROOK, (y * 8 + 7));
             setPiece(color, ROOK, (y * 8 + 5));
         }
         else
         {
             // Move rook to D file
-            m_bitboards[color][ALL] ^= (1ULL << (y * 8));
-            m_bitboards[color][ROOK] ^= (1ULL << (y * 8));
-            m_pieces[(y * 8)] = 0;
+            removePiece(color, ROOK, (y * 8));
             setPiece(color, ROOK, (y * 8 + 3));
         }
         m_castling_rights &= ~((WK | WQ) << (color * 2));
@@ -175,13 +200,9 @@ uint64_t BitBoard::movePiece(int8_t from, int8_t to, uint8_t promotion_piece)
             else if ((captured_pos == 7 && captured_color == BLACK) || (captured_pos == 63 && captured_color == WHITE))
                 m_castling_rights &= ~(WK << (!color * 2));
         }
-        m_bitboards[captured_color][ALL]      ^= (1ULL << captured_pos);
-        m_bitboards[captured_color][captured] ^= (1ULL << captured_pos);
-        m_pieces[captured_pos] = 0;
+        removePiece(captured_color, captured, captured_pos);
     }
-    m_bitboards[color][ALL]    ^= (1ULL << from);
-    m_bitboards[color][piece]  ^= (1ULL << from);
-    m_pieces[from] = 0;
+    removePiece(color, piece, from);
     setPiece(color, (promotion_piece == 0 ? piece : promotion_piece), to);
 
     if (piece == PAWN && std::abs(to - from) == 16)
@@ -190,133 +211,30 @@ uint64_t BitBoard::movePiece(int8_t from, int8_t to, uint8_t promotion_piece)
         m_en_passant_square = -1;
 
     m_player_to_move = !m_player_to_move;
+    m_key ^= ZOBRIST_CASTLING[m_castling_rights] ^ ZOBRIST_WHITE_TO_MOVE ^ en_passant_key();
 
+    m_halfmove_clock = (piece == PAWN || captured) ? 0 : std::min(m_halfmove_clock + 1, 255);
     m_last_move_to = to;
+#ifdef CHESS_DEBUG
+    assert(m_key == computeKey());
+#endif
     return encodedMove;
 }
 
 std::vector<uint16_t> BitBoard::get_capture_moves(uint8_t color) const
 {
-    uint64_t all_pieces = allPieces();
-    std::vector<uint16_t> moves;
-    moves.reserve(10);
-
-    uint8_t king_square = __builtin_ctzll(m_bitboards[color][KING]);
-    uint64_t checkers = squareAttackers(king_square, !color);
-    uint8_t num_checkers = countBits(checkers);
-
-    uint64_t attack_mask = get_attack_mask(!color);
-    uint64_t check_resolve_capture_mask = 0xFFFFFFFFFFFFFFFFULL;
-    uint64_t check_resolve_push_mask = 0xFFFFFFFFFFFFFFFFULL;
-    check_resolve_capture_mask = checkers;
-
-    uint64_t pinned = 0;
-    uint64_t pinners = xrayRookAttacks(m_bitboards[color][ALL], king_square) & (m_bitboards[!color][ROOK] | m_bitboards[!color][QUEEN]);
-    uint64_t tmpPinners = pinners;
-    while (tmpPinners)
-    {
-        uint8_t square = __builtin_ctzll(tmpPinners);
-        tmpPinners &= tmpPinners - 1;
-        pinned |= create_ray(square, king_square) & m_bitboards[color][ALL];
-    }
-    tmpPinners = xrayBishopAttacks(m_bitboards[color][ALL], king_square) & (m_bitboards[!color][BISHOP] | m_bitboards[!color][QUEEN]);
-    pinners |= tmpPinners;
-    while (tmpPinners)
-    {
-        uint8_t square = __builtin_ctzll(tmpPinners);
-        tmpPinners &= tmpPinners - 1;
-        pinned |= create_ray(square, king_square) & m_bitboards[color][ALL];
-    }
-
-    if (checkers)
-    {
-        uint8_t checker_square = __builtin_ctzll(checkers);
-        uint8_t checker_piece = at(checker_square);
-        if (checker_piece == BISHOP || checker_piece == ROOK || checker_piece == QUEEN)
-            check_resolve_push_mask = create_ray(king_square, checker_square) & ~(m_bitboards[color][ALL]);
-        else
-            check_resolve_push_mask = 0;
-    }
-
-    for (size_t piece_type = (num_checkers > 1 ? KING : 1); piece_type < m_bitboards[color].size(); piece_type++)
-    {
-        uint64_t pieces = m_bitboards[color][piece_type];
-        while (pieces)
-        {
-            uint8_t square = __builtin_ctzll(pieces);
-            pieces &= pieces - 1;
-
-            uint64_t moveBoard = 0;
-            switch (piece_type)
-            {
-            case PAWN:
-                moveBoard = get_pawn_moves(square);
-                break;
-            case KNIGHT:
-                moveBoard = KNIGHT_MOVES[square] & ~(m_bitboards[color][ALL]);
-                break;
-            case KING:
-                moveBoard = KING_MOVES[square] & ~(m_bitboards[color][ALL]);
-                break;
-            case BISHOP:
-                moveBoard = get_bishop_moves(square, all_pieces) & ~(m_bitboards[color][ALL]);
-                break;
-            case ROOK:
-                moveBoard = get_rook_moves(square, all_pieces) & ~(m_bitboards[color][ALL]);
-                break;
-            case QUEEN:
-                moveBoard = (get_rook_moves(square, all_pieces) | get_bishop_moves(square, all_pieces)) & ~(m_bitboards[color][ALL]);
-                break;
-            }
-
-            if (pinned & (1ULL << square) && piece_type != KING)
-            {
-                if (piece_type == KNIGHT)
-                    moveBoard = 0;
-                else
-                {
-                    uint64_t pinner = pinners;
-                    while (pinner)
-                    {
-                        uint8_t pinner_square = __builtin_ctzll(pinner);
-                        pinner &= pinner - 1;
-                        uint64_t ray = create_ray(king_square, pinner_square);
-                        if (ray & (1ULL << square))
-                        {
-                            moveBoard &= ray;
-                            break;
-                        }
-                    }
-                }
-            }
-
-            if (piece_type != KING)
-                moveBoard &= (check_resolve_capture_mask | check_resolve_push_mask | (piece_type == PAWN && m_en_passant_square != 255 ? (1ULL << m_en_passant_square) : 0));
-            else
-                moveBoard &= ~(attack_mask);
-            
-            // Captures only
-            moveBoard &= (m_bitboards[!color][ALL] | (piece_type == PAWN && m_en_passant_square != 255 ? (1ULL << m_en_passant_square) : 0));
-
-            while (moveBoard)
-            {
-                uint8_t to = __builtin_ctzll(moveBoard);
-                if (piece_type == PAWN && ((1ULL << to) & (ROW_1 | ROW_8)))
-                {
-                    moves.push_back(to | ((square & 0b111111) << 6) | (QUEEN << 12));
-                    moves.push_back(to | ((square & 0b111111) << 6) | (KNIGHT << 12));
-                    moves.push_back(to | ((square & 0b111111) << 6) | (ROOK << 12));
-                    moves.push_back(to | ((square & 0b111111) << 6) | (BISHOP << 12));
-                    moveBoard &= moveBoard - 1;
-                    continue;
-                }
-                moveBoard &= moveBoard - 1;
-                moves.push_back(to | ((square & 0b111111) << 6));
-            }
-        }
-    }
+    MoveList moves;
+    get_capture_moves(color, moves);
+    return std::vector<uint16_t>(moves.begin(), moves.end());
+}
 
-    return moves;
+void BitBoard::get_capture_moves(uint8_t color, MoveList& moves) const
+{
+    uint64_t checkers = squareAttackers(__builtin_ctzll(m_bitboards[color][KING]), !color);
+    if (color == WHITE)
+        generate_moves<WHITE, GEN_CAPTURES>(moves, checkers);
+    else
+        generate_moves<BLACK, GEN_CAPTURES>(moves, checkers);
 }
 
 void BitBoard::undoMove(uint64_t move)
@@ -330,7 +248,9 @@ void BitBoard::undoMove(uint64_t move)
     uint8_t color = colorBoard(WHITE) & (1ULL << to) ? WHITE : BLACK;
     uint8_t old_piece = (move >> 34) & 0b111;
 
-    m_last_move_to = (move >> 37) & 0b111111;
+    m_key ^= ZOBRIST_CASTLING[m_castling_rights] ^ en_passant_key();
+    m_last_move_to = (move >> 37) & 0b1111111;
+    m_halfmove_clock = (move >> 44) & 0xFF;
     m_en_passant_square = (move >> 22) & 0b11111111;
     m_castling_rights = (move >> 30) & 0b1111;
     if (piece == KING && std::abs(from - to) > 1 && std::abs(from - to) < 7)
@@ -339,32 +259,54 @@ void BitBoard::undoMove(uint64_t move)
         if (to - from > 0)
         {
             // Move rook to H file
-            m_bitboards[color][ALL] ^= (1ULL << (y * 8 + 5));
-            m_bitboards[color][ROOK] ^= (1ULL << (y * 8 + 5));
-            m_pieces[y * 8 + 5] = 0;
+            removePiece(color, ROOK, (y * 8 + 5));
             setPiece(color, ROOK, (y * 8 + 7));
         }
         else
         {
             // Move rook to A file
-            m_bitboards[color][ALL] ^= (1ULL << (y * 8 + 3));
-            m_bitboards[color][ROOK] ^= (1ULL << (y * 8 + 3));
-            m_pieces[(y * 8 + 3)] = 0;
+            removePiece(color, ROOK, (y * 8 + 3));
             setPiece(color, ROOK, (y * 8));
         }
     }
 
-    m_pieces[to] = 0;
+    removePiece(color, piece, to);
     if (captured)
-    {
-        m_bitboards[captured_color][ALL]      |= (1ULL << captured_pos);
-        m_bitboards[captured_color][captured] |= (1ULL << captured_pos);
-        m_pieces[captured_pos] = captured;
-    }
-    m_bitboards[color][ALL] ^= (1ULL << to);
-    m_bitboards[color][piece] ^= (1ULL << to);
+        setPiece(captured_color, captured, captured_pos);
     setPiece(color, old_piece, from);
     m_player_to_move = !m_player_to_move;
+    m_key ^= ZOBRIST_CASTLING[m_castling_rights] ^ ZOBRIST_WHITE_TO_MOVE ^ en_passant_key();
+#ifdef CHESS_DEBUG
+    assert(m_key == computeKey());
+#endif
+}
+
+/* Passes the turn, for null move pruning. Returns what undoNullMove needs to restore.
+   The halfmove clock restarts so that no repetition is looked for across the null move */
+uint64_t BitBoard::makeNullMove()
+{
+    uint64_t encodedMove = m_en_passant_square | (static_cast<uint64_t>(m_last_move_to) << 8) | (static_cast<uint64_t>(m_halfmove_clock) << 16);
+    m_key ^= en_passant_key() ^ ZOBRIST_WHITE_TO_MOVE;
+    m_en_passant_square = 255;
+    m_last_move_to = 64;
+    m_halfmove_clock = 0;
+    m_player_to_move = !m_player_to_move;
+#ifdef CHESS_DEBUG
+    assert(m_key == computeKey());
+#endif
+    return encodedMove;
+}
+
+void BitBoard::undoNullMove(uint64_t move)
+{
+    m_player_to_move = !m_player_to_move;
+    m_en_passant_square = move & 0xFF;
+    m_last_move_to = (move >> 8) & 0xFF;
+    m_halfmove_clock = (move >> 16) & 0xFF;
+    m_key ^= en_passant_key() ^ ZOBRIST_WHITE_TO_MOVE;
+#ifdef CHESS_DEBUG
+    assert(m_key == computeKey());
+#endif
 }
 
 bool BitBoard::isCorrupted() const
@@ -416,16 +358,6 @@ bool BitBoard::isCorrupted() const
     return false;
 }
 
-BitBoard& BitBoard::operator=(const BitBoard& other)
-{
-    this->m_bitboards = other.m_bitboards;
-    m_check = other.m_check;
-    m_castling_rights = other.m_castling_rights;
-    m_en_passant_square = other.m_en_passant_square;
-    m_last_move_to = 0;
-    return *this;
-}
-
 uint64_t BitBoard::pieceBoard(uint8_t color, uint8_t piece) const
 {
     return m_bitboards[color][piece];
@@ -456,301 +388,341 @@ void BitBoard::setPiece(uint8_t color, uint8_t piece, uint8_t bit)
     m_bitboards[color][piece] |= 1ULL << bit;
     m_bitboards[color][ALL] |= 1ULL << bit;
     m_pieces[bit] = piece;
+    m_key ^= zobrist_piece(color, piece, bit);
 }
 
-uint64_t BitBoard::get_attack_mask(uint8_t color) const
+void BitBoard::removePiece(uint8_t color, uint8_t piece, uint8_t bit)
+{
+    m_bitboards[color][piece] ^= 1ULL << bit;
+    m_bitboards[color][ALL] ^= 1ULL << bit;
+    m_pieces[bit] = 0;
+    m_key ^= zobrist_piece(color, piece, bit);
+}
+
+/* Polyglot only hashes the en passant file when a pawn of the side to move stands next to the pawn that just moved */
+uint64_t BitBoard::en_passant_key() const
+{
+    if (m_en_passant_square == 255)
+        return 0;
+    uint8_t en_passant_pawn_square = m_en_passant_square + (m_player_to_move == WHITE ? 8 : -8);
+    bool can_en_passant = ((ROWS[en_passant_pawn_square / 8] & ((1ULL << (en_passant_pawn_square + 1)) | (1ULL << (en_passant_pawn_square - 1)))
+                                & m_bitboards[m_player_to_move][PAWN]) != 0);
+    return can_en_passant ? ZOBRIST_KEYS[772 + (m_en_passant_square % 8)] : 0;
+}
+
+/* Full recomputation of the key, movePiece and undoMove keep m_key equal to it incrementally */
+uint64_t BitBoard::computeKey() const
 {
-    uint64_t mask = 0;
-    uint64_t occupancy = allPieces() & ~(m_bitboards[!color][KING]);
-    uint8_t y_offset = color == WHITE ? -1 : 1;
-    for (uint8_t piece_type = 1; piece_type < m_bitboards[color].size(); piece_type++)
+    uint64_t key = 0;
+    for (uint8_t color = WHITE; color <= BLACK; color++)
     {
-        uint64_t piece_board = m_bitboards[color][piece_type];
-        while (piece_board)
+        for (uint8_t piece = PAWN; piece <= KING; piece++)
         {
-            uint8_t square = __builtin_ctzll(piece_board);
-            piece_board &= piece_board - 1;
-            switch (piece_type)
+            uint64_t pieces = m_bitboards[color][piece];
+            while (pieces)
             {
-                case PAWN:
-                    if (!((1ULL << square) & FILE_A))
-                        mask |= (1ULL << (square + y_offset * 8 - 1));
-                    if (!((1ULL << square) & FILE_H))
-                        mask |= (1ULL << (square + y_offset * 8 + 1));
-                    break;
-                case KNIGHT:
-                    mask |= KNIGHT_MOVES[square];
-                    break;
-                case BISHOP:
-                    mask |= get_bishop_moves(square, occupancy);
-                    break;
-                case ROOK:
-                    mask |= get_rook_moves(square, occupancy);
-                    break;
-                case QUEEN:
-                    mask |= get_bishop_moves(square, occupancy) | get_rook_moves(square, occupancy);
-                    break;
-                case KING:
-                    mask |= KING_MOVES[square];
-                    break;
+                key ^= zobrist_piece(color, piece, __builtin_ctzll(pieces));
+                pieces &= pieces - 1;
             }
         }
     }
-    return mask;
+    key ^= ZOBRIST_CASTLING[m_castling_rights] ^ en_passant_key();
+    if (m_player_to_move == WHITE)
+        key ^= ZOBRIST_WHITE_TO_MOVE;
+    return key;
 }
 
-uint64_t BitBoard::create_ray(uint8_t from, uint8_t to) const
+bool BitBoard::isCapture(uint16_t move) const
 {
-    uint8_t x_from = from % 8;
-    uint8_t y_from = from / 8;
-    uint8_t x_to = to % 8;
-    uint8_t y_to = to / 8;
-    uint64_t ray = 0;
-    if (x_from == x_to)
-    {
-        for (uint8_t y = std::min(y_from, y_to); y <= std::max(y_from, y_to); y++)
-            ray |= (1ULL << (y * 8 + x_from));
-    }
-    else if (y_from == y_to)
+    return (allPieces() & (1ULL << (move & 0b111111))) || ((move & 0b111111) == m_en_passant_square && m_pieces[(move >> 6 & 0b111111)] == PAWN);
+}
+
+/* Whether a move that was not generated here (transposition table move, killer) is legal in this position */
+bool BitBoard::isLegal(uint16_t move) const
+{
+    uint8_t to = move & 0b111111;
+    uint8_t from = (move >> 6) & 0b111111;
+    uint8_t promotion_piece = move >> 12;
+    uint8_t color = m_player_to_move;
+    uint64_t to_board = 1ULL << to;
+    uint64_t all_pieces = allPieces();
+
+    if (!(m_bitboards[color][ALL] & (1ULL << from)) || (m_bitboards[color][ALL] & to_board))
+        return false;
+    uint8_t piece = m_pieces[from];
+    bool promotes = piece == PAWN && (to_board & (ROW_1 | ROW_8));
+    if (promotes != (promotion_piece != 0) || (promotes && (promotion_piece < KNIGHT || promotion_piece > QUEEN)))
+        return false;
+
+    uint64_t reachable = 0;
+    switch (piece)
     {
-        for (uint8_t x = std::min(x_from, x_to); x <= std::max(x_from, x_to); x++)
-            ray |= (1ULL << (y_from * 8 + x));
-    }
-    else if (x_from == x_to)
+    case PAWN:
     {
-        for (uint8_t y = std::min(y_from, y_to); y <= std::max(y_from, y_to); y++)
-            ray |= (1ULL << (y * 8 + x_from));
+        uint64_t from_board = 1ULL << from;
+        uint64_t en_passant = m_en_passant_square != 255 ? (1ULL << m_en_passant_square) : 0;
+        uint64_t single_push = (color == WHITE ? pawn_push<WHITE>(from_board) : pawn_push<BLACK>(from_board)) & ~all_pieces;
+        uint64_t double_push = (color == WHITE ? pawn_push<WHITE>(single_push) & ROW_5 : pawn_push<BLACK>(single_push) & ROW_4) & ~all_pieces;
+        uint64_t attacks = color == WHITE ? pawn_attacks_west<WHITE>(from_board) | pawn_attacks_east<WHITE>(from_board)
+                                          : pawn_attacks_west<BLACK>(from_board) | pawn_attacks_east<BLACK>(from_board);
+        reachable = single_push | double_push | (attacks & (m_bitboards[!color][ALL] | en_passant));
+        break;
     }
-    else
-    {
-        int8_t x_diff = x_to - x_from;
-        int8_t y_diff = y_to - y_from;
-        int8_t x_step = x_diff > 0 ? 1 : -1;
-        int8_t y_step = y_diff > 0 ? 1 : -1;
-        int8_t x = x_from;
-        int8_t y = y_from;
-        while (x != x_to || y != y_to)
+    case KNIGHT:
+        reachable = KNIGHT_MOVES[from];
+        break;
+    case BISHOP:
+        reachable = get_bishop_moves(from, all_pieces);
+        break;
+    case ROOK:
+        reachable = get_rook_moves(from, all_pieces);
+        break;
+    case QUEEN:
+        reachable = get_rook_moves(from, all_pieces) | get_bishop_moves(from, all_pieces);
+        break;
+    case KING:
+        reachable = KING_MOVES[from];
+        if (from == (color == WHITE ? 60 : 4) && (to == from + 2 || to == from - 2))
         {
-            ray |= (1ULL << (y * 8 + x));
-            x += x_step;
-            y += y_step;
+            uint8_t right = (to > from ? WK : WQ) << (color * 2);
+            uint64_t path = color == WHITE ? (to > from ? WK_MASK : WQ_MASK) : (to > from ? BK_MASK : BQ_MASK);
+            uint64_t attack_path = color == WHITE ? (to > from ? WK_MASK : WQ_ATTACK_MASK) : (to > from ? BK_MASK : BQ_ATTACK_MASK);
+            return (m_castling_rights & right) && !(all_pieces & path) && !squareAttackers(from, !color)
+                && !(get_attack_mask(!color) & attack_path);
         }
+        break;
     }
-    ray ^= (1ULL << from);
-    ray |= (1ULL << to);
-    return ray;
+    if (!(reachable & to_board))
+        return false;
+
+    BitBoard after = *this;
+    after.movePiece(from, to, promotion_piece);
+    return !after.squareAttackers(__builtin_ctzll(after.m_bitboards[color][KING]), !color);
 }
 
-bool BitBoard::isCapture(uint16_t move) const
+std::vector<uint16_t> BitBoard::get_moves(uint8_t color) const
 {
-    return (allPieces() & (move & 0b111111)) || ((move & 0b111111) == m_en_passant_square && m_pieces[(move >> 6 & 0b111111)] == PAWN);
+    MoveList moves;
+    get_moves(color, moves);
+    return std::vector<uint16_t>(moves.begin(), moves.end());
 }
 
-std::vector<uint16_t> BitBoard::get_moves(uint8_t color) const
+void BitBoard::get_moves(uint8_t color, MoveList& moves) const
 {
-    uint64_t all_pieces = allPieces();
-    std::vector<uint16_t> moves;
-    moves.reserve(40);
+    uint64_t checkers = squareAttackers(__builtin_ctzll(m_bitboards[color][KING]), !color);
+    if (color == WHITE)
+        checkers ? generate_moves<WHITE, GEN_EVASIONS>(moves, checkers) : generate_moves<WHITE, GEN_ALL>(moves, checkers);
+    else
+        checkers ? generate_moves<BLACK, GEN_EVASIONS>(moves, checkers) : generate_moves<BLACK, GEN_ALL>(moves, checkers);
+}
 
-    uint8_t king_square = __builtin_ctzll(m_bitboards[color][KING]);
-    uint64_t checkers = squareAttackers(king_square, !color);
-    uint8_t num_checkers = countBits(checkers);
+void BitBoard::get_quiet_moves(uint8_t color, MoveList& moves) const
+{
+    uint64_t checkers = squareAttackers(__builtin_ctzll(m_bitboards[color][KING]), !color);
+    if (color == WHITE)
+        generate_moves<WHITE, GEN_QUIETS>(moves, checkers);
+    else
+        generate_moves<BLACK, GEN_QUIETS>(moves, checkers);
+}
 
-    uint64_t attack_mask = get_attack_mask(!color);
-    uint64_t check_resolve_capture_mask = 0xFFFFFFFFFFFFFFFFULL;
-    uint64_t check_resolve_push_mask = 0xFFFFFFFFFFFFFFFFULL;
-    check_resolve_capture_mask = checkers;
+/* Generates the legal moves of Color, restricted to captures or quiets depending on Type.
+** checkers are the pieces giving check to Color: GEN_ALL is only used when there are none, GEN_EVASIONS only when there are some. */
+template <uint8_t Color, GenType Type>
+void BitBoard::generate_moves(MoveList& moves, uint64_t checkers) const
+{
+    constexpr uint8_t Them = !Color;
+    constexpr int PUSH = Color == WHITE ? -8 : 8;
+    constexpr int WEST_CAPTURE = Color == WHITE ? -9 : 7;
+    constexpr int EAST_CAPTURE = Color == WHITE ? -7 : 9;
+    constexpr uint64_t PROMOTION_ROW = Color == WHITE ? ROW_1 : ROW_8;
+    constexpr uint64_t DOUBLE_PUSH_ROW = Color == WHITE ? ROW_5 : ROW_4;
+
+    const uint64_t us = m_bitboards[Color][ALL];
+    const uint64_t them = m_bitboards[Them][ALL];
+    const uint64_t all_pieces = us | them;
+    const uint8_t king_square = __builtin_ctzll(m_bitboards[Color][KING]);
+    const uint64_t attacked = attack_mask<Them>();
+
+    // Squares the pieces may land on, for the kind of moves asked
+    const uint64_t targets = Type == GEN_CAPTURES ? them : (Type == GEN_QUIETS ? ~all_pieces : ~us);
+
+    uint64_t moveBoard = KING_MOVES[king_square] & targets & ~attacked;
+    while (moveBoard)
+    {
+        moves.push_back(__builtin_ctzll(moveBoard) | (king_square << 6));
+        moveBoard &= moveBoard - 1;
+    }
+
+    // Only the king can move out of a double check
+    if (Type != GEN_ALL && (checkers & (checkers - 1)))
+        return;
+
+    // Out of check, other pieces have to capture the checker or block it
+    uint64_t check_mask = 0xFFFFFFFFFFFFFFFFULL;
+    if (Type != GEN_ALL && checkers)
+        check_mask = checkers | BETWEEN[king_square][__builtin_ctzll(checkers)];
 
     uint64_t pinned = 0;
-    uint64_t pinners = xrayRookAttacks(m_bitboards[color][ALL], king_square) & (m_bitboards[!color][ROOK] | m_bitboards[!color][QUEEN]);
-    uint64_t tmpPinners = pinners;
-    while (tmpPinners)
+    uint64_t pinners = (xrayRookAttacks(us, king_square) & (m_bitboards[Them][ROOK] | m_bitboards[Them][QUEEN]))
+                     | (xrayBishopAttacks(us, king_square) & (m_bitboards[Them][BISHOP] | m_bitboards[Them][QUEEN]));
+    while (pinners)
     {
-        uint8_t square = __builtin_ctzll(tmpPinners);
-        tmpPinners &= tmpPinners - 1;
-        pinned |= create_ray(square, king_square) & m_bitboards[color][ALL];
+        uint8_t square = __builtin_ctzll(pinners);
+        pinners &= pinners - 1;
+        pinned |= BETWEEN[square][king_square] & us;
     }
-    tmpPinners = xrayBishopAttacks(m_bitboards[color][ALL], king_square) & (m_bitboards[!color][BISHOP] | m_bitboards[!color][QUEEN]);
-    pinners |= tmpPinners;
-    while (tmpPinners)
+
+    // Pawns move all at once, the origin of each move is found back from its offset
+    auto add_pawn_moves = [&](uint64_t destinations, int offset) {
+        while (destinations)
+        {
+            uint8_t to = __builtin_ctzll(destinations);
+            uint8_t from = to - offset;
+            destinations &= destinations - 1;
+            // A pinned piece can only move along the line going through its king and itself
+            if ((pinned & (1ULL << from)) && !(LINE[king_square][from] & (1ULL << to)))
+                continue;
+            if ((1ULL << to) & PROMOTION_ROW)
+            {
+                moves.push_back(to | (from << 6) | (QUEEN << 12));
+                moves.push_back(to | (from << 6) | (KNIGHT << 12));
+                moves.push_back(to | (from << 6) | (ROOK << 12));
+                moves.push_back(to | (from << 6) | (BISHOP << 12));
+            }
+            else
+                moves.push_back(to | (from << 6));
+        }
+    };
+
+    uint64_t pawns = m_bitboards[Color][PAWN];
+    if (Type != GEN_CAPTURES)
     {
-        uint8_t square = __builtin_ctzll(tmpPinners);
-        tmpPinners &= tmpPinners - 1;
-        pinned |= create_ray(square, king_square) & m_bitboards[color][ALL];
+        uint64_t single_pushes = pawn_push<Color>(pawns) & ~all_pieces;
+        uint64_t double_pushes = pawn_push<Color>(single_pushes) & ~all_pieces & DOUBLE_PUSH_ROW;
+        add_pawn_moves(single_pushes & check_mask, PUSH);
+        add_pawn_moves(double_pushes & check_mask, 2 * PUSH);
     }
-
-    if (checkers)
+    if (Type != GEN_QUIETS)
     {
-        uint8_t checker_square = __builtin_ctzll(checkers);
-        uint8_t checker_piece = at(checker_square);
-        if (checker_piece == BISHOP || checker_piece == ROOK || checker_piece == QUEEN)
-            check_resolve_push_mask = create_ray(king_square, checker_square) & ~(m_bitboards[color][ALL]);
-        else
-            check_resolve_push_mask = 0;
+        add_pawn_moves(pawn_attacks_west<Color>(pawns) & them & check_mask, WEST_CAPTURE);
+        add_pawn_moves(pawn_attacks_east<Color>(pawns) & them & check_mask, EAST_CAPTURE);
+
+        if (m_en_passant_square != 255)
+        {
+            uint8_t captured_square = m_en_passant_square - PUSH;
+            // The en passant capture has to take the checking pawn or block the check
+            if ((check_mask & ((1ULL << captured_square) | (1ULL << m_en_passant_square))))
+            {
+                uint64_t capturers = pawns & (pawn_attacks_west<Them>(1ULL << m_en_passant_square) | pawn_attacks_east<Them>(1ULL << m_en_passant_square));
+                while (capturers)
+                {
+                    uint8_t from = __builtin_ctzll(capturers);
+                    capturers &= capturers - 1;
+                    // Both pawns leave the rank at once, which can uncover the king
+                    uint64_t occupancy = (all_pieces ^ (1ULL << from) ^ (1ULL << captured_square)) | (1ULL << m_en_passant_square);
+                    if ((get_rook_moves(king_square, occupancy) & (m_bitboards[Them][ROOK] | m_bitboards[Them][QUEEN]))
+                        || (get_bishop_moves(king_square, occupancy) & (m_bitboards[Them][BISHOP] | m_bitboards[Them][QUEEN])))
+                        continue;
+                    moves.push_back(m_en_passant_square | (from << 6));
+                }
+            }
+        }
     }
 
-    for (size_t piece_type = (num_checkers > 1 ? KING : 1); piece_type < m_bitboards[color].size(); piece_type++)
+    const uint64_t piece_targets = targets & check_mask;
+    for (uint8_t piece_type = KNIGHT; piece_type <= QUEEN; piece_type++)
     {
-        uint64_t pieces = m_bitboards[color][piece_type];
+        uint64_t pieces = m_bitboards[Color][piece_type];
         while (pieces)
         {
             uint8_t square = __builtin_ctzll(pieces);
             pieces &= pieces - 1;
 
-            uint64_t moveBoard = 0;
             switch (piece_type)
             {
-            case PAWN:
-                moveBoard = get_pawn_moves(square);
-                break;
             case KNIGHT:
-                moveBoard = KNIGHT_MOVES[square] & ~(m_bitboards[color][ALL]);
-                break;
-            case KING:
-                moveBoard = KING_MOVES[square] & ~(m_bitboards[color][ALL]);
+                moveBoard = KNIGHT_MOVES[square];
                 break;
             case BISHOP:
-                moveBoard = get_bishop_moves(square, all_pieces) & ~(m_bitboards[color][ALL]);
+                moveBoard = get_bishop_moves(square, all_pieces);
                 break;
             case ROOK:
-                moveBoard = get_rook_moves(square, all_pieces) & ~(m_bitboards[color][ALL]);
+                moveBoard = get_rook_moves(square, all_pieces);
                 break;
             case QUEEN:
-                moveBoard = (get_rook_moves(square, all_pieces) | get_bishop_moves(square, all_pieces)) & ~(m_bitboards[color][ALL]);
+                moveBoard = get_rook_moves(square, all_pieces) | get_bishop_moves(square, all_pieces);
                 break;
             }
-
-            if (pinned & (1ULL << square) && piece_type != KING)
-            {
-                if (piece_type == KNIGHT)
-                    moveBoard = 0;
-                else
-                {
-                    uint64_t pinner = pinners;
-                    while (pinner)
-                    {
-                        uint8_t pinner_square = __builtin_ctzll(pinner);
-                        pinner &= pinner - 1;
-                        uint64_t ray = create_ray(king_square, pinner_square);
-                        if (ray & (1ULL << square))
-                        {
-                            moveBoard &= ray;
-                            break;
-                        }
-                    }
-                }
-            }
-
-            if (piece_type != KING)
-                moveBoard &= (check_resolve_capture_mask | check_resolve_push_mask | (piece_type == PAWN && m_en_passant_square != 255 ? (1ULL << m_en_passant_square) : 0));
-            else
-                moveBoard &= ~(attack_mask);
+            moveBoard &= piece_targets;
+            if (pinned & (1ULL << square))
+                moveBoard &= LINE[king_square][square];
 
             while (moveBoard)
             {
-                uint8_t to = __builtin_ctzll(moveBoard);
-                if (piece_type == PAWN && ((1ULL << to) & (ROW_1 | ROW_8)))
-                {
-                    moves.push_back(to | ((square & 0b111111) << 6) | (QUEEN << 12));
-                    moves.push_back(to | ((square & 0b111111) << 6) | (KNIGHT << 12));
-                    moves.push_back(to | ((square & 0b111111) << 6) | (ROOK << 12));
-                    moves.push_back(to | ((square & 0b111111) << 6) | (BISHOP << 12));
-                    moveBoard &= moveBoard - 1;
-                    continue;
-                }
+                moves.push_back(__builtin_ctzll(moveBoard) | (square << 6));
                 moveBoard &= moveBoard - 1;
-                moves.push_back(to | ((square & 0b111111) << 6));
             }
         }
     }
 
-    if (!checkers)
+    if (Type == GEN_ALL || (Type == GEN_QUIETS && !checkers))
     {
-        switch (color)
-        {
-        case WHITE:
-            if ((m_castling_rights & WQ) && !(all_pieces & WQ_MASK) && !(WQ_ATTACK_MASK & attack_mask))
-                moves.push_back(58 | (60 << 6));
-            if ((m_castling_rights & WK) && !(all_pieces & WK_MASK) && !(WK_MASK & attack_mask))
-                moves.push_back(62 | (60 << 6));
-            break;
-        case BLACK:
-            if ((m_castling_rights & BQ) && !(all_pieces & BQ_MASK) && !(BQ_ATTACK_MASK & attack_mask))
-                moves.push_back(2 | (4 << 6));
-            if ((m_castling_rights & BK) && !(all_pieces & BK_MASK) && !(BK_MASK & attack_mask))
-                moves.push_back(6 | (4 << 6));
-            break;
-        }
+        constexpr uint8_t KING_SIDE = Color == WHITE ? WK : BK;
+        constexpr uint8_t QUEEN_SIDE = Color == WHITE ? WQ : BQ;
+        constexpr uint64_t KING_SIDE_MASK = Color == WHITE ? WK_MASK : BK_MASK;
+        constexpr uint64_t QUEEN_SIDE_MASK = Color == WHITE ? WQ_MASK : BQ_MASK;
+        constexpr uint64_t QUEEN_SIDE_ATTACK_MASK = Color == WHITE ? WQ_ATTACK_MASK : BQ_ATTACK_MASK;
+        constexpr uint16_t KING_FROM = Color == WHITE ? 60 : 4;
+
+        if ((m_castling_rights & QUEEN_SIDE) && !(all_pieces & QUEEN_SIDE_MASK) && !(QUEEN_SIDE_ATTACK_MASK & attacked))
+            moves.push_back((KING_FROM - 2) | (KING_FROM << 6));
+        if ((m_castling_rights & KING_SIDE) && !(all_pieces & KING_SIDE_MASK) && !(KING_SIDE_MASK & attacked))
+            moves.push_back((KING_FROM + 2) | (KING_FROM << 6));
     }
-    return moves;
 }
 
-uint64_t BitBoard::get_pawn_moves(uint8_t square) const
+uint64_t BitBoard::get_attack_mask(uint8_t color) const
 {
-    uint64_t moves = 0;
-    uint8_t rank = square / 8;
-    uint8_t file = square % 8;
-    uint8_t color = colorBoard(WHITE) & (1ULL << square) ? WHITE : BLACK;
+    return color == WHITE ? attack_mask<WHITE>() : attack_mask<BLACK>();
+}
 
-    uint64_t all_pieces = allPieces();
+/* Every square attacked by Color, seen through the enemy king so that it cannot step back along a slider's ray */
+template <uint8_t Color>
+uint64_t BitBoard::attack_mask() const
+{
+    uint64_t occupancy = allPieces() & ~(m_bitboards[!Color][KING]);
+    uint64_t mask = pawn_attacks_west<Color>(m_bitboards[Color][PAWN]) | pawn_attacks_east<Color>(m_bitboards[Color][PAWN]);
+    mask |= KING_MOVES[__builtin_ctzll(m_bitboards[Color][KING])];
 
-    switch (color)
+    uint64_t pieces = m_bitboards[Color][KNIGHT];
+    while (pieces)
     {
-    case WHITE:
-        if (!(all_pieces & (1ULL << (square - 8))))
-        {
-            moves |= (1ULL << (square - 8));
-            if (rank == 6 && !(all_pieces & (1ULL << (square - 16))))
-                moves |= (1ULL << (square - 16));
-        }
-        if (file > 0 && (colorBoard(BLACK) & (1ULL << (square - 8 - 1)) || m_en_passant_square == square - 8 - 1))
-            moves |= (1ULL << (square - 8 - 1));
-        if (file < 7 && (colorBoard(BLACK) & (1ULL << (square - 8 + 1)) || m_en_passant_square == square - 8 + 1))
-            moves |= (1ULL << (square - 8 + 1));
-        if (m_en_passant_square != 255 && (moves & (1ULL << m_en_passant_square)))
-        {
-            uint64_t blockers = all_pieces & ~((1ULL << square) | (1ULL << (m_en_passant_square + 8)));
-            if ((get_rook_moves(__builtin_ctzll(m_bitboards[color][KING]), blockers) & (m_bitboards[!color][ROOK] | m_bitboards[!color][QUEEN]))
-                || (get_bishop_moves(__builtin_ctzll(m_bitboards[color][KING]), blockers) & (m_bitboards[!color][BISHOP] | m_bitboards[!color][QUEEN])))
-                moves ^= (1ULL << m_en_passant_square);
-        }
-        break;
-    case BLACK:
-        if (!(all_pieces & (1ULL << (square + 8))))
-        {
-            moves |= (1ULL << (square + 8));
-            if (rank == 1 && !(all_pieces & (1ULL << (square + 16))))
-                moves |= (1ULL << (square + 16));
-        }
-        if (file > 0 && (colorBoard(WHITE) & (1ULL << (square + 8 - 1)) || m_en_passant_square == square + 8 - 1))
-            moves |= (1ULL << (square + 8 - 1));
-        if (file < 7 && (colorBoard(WHITE) & (1ULL << (square + 8 + 1)) || m_en_passant_square == square + 8 + 1))
-            moves |= (1ULL << (square + 8 + 1));
-        if (m_en_passant_square != 255 && (moves & (1ULL << m_en_passant_square)))
-        {
-            uint64_t blockers = all_pieces & ~((1ULL << square) | (1ULL << (m_en_passant_square - 8)));
-            if ((get_rook_moves(__builtin_ctzll(m_bitboards[color][KING]), blockers) & (m_bitboards[!color][ROOK] | m_bitboards[!color][QUEEN]))
-                || (get_bishop_moves(__builtin_ctzll(m_bitboards[color][KING]), blockers) & (m_bitboards[!color][BISHOP] | m_bitboards[!color][QUEEN])))
-                moves ^= (1ULL << m_en_passant_square);
-        }
-        break;
+        mask |= KNIGHT_MOVES[__builtin_ctzll(pieces)];
+        pieces &= pieces - 1;
     }
-
-    return moves;
+    pieces = m_bitboards[Color][BISHOP] | m_bitboards[Color][QUEEN];
+    while (pieces)
+    {
+        mask |= get_bishop_moves(__builtin_ctzll(pieces), occupancy);
+        pieces &= pieces - 1;
+    }
+    pieces = m_bitboards[Color][ROOK] | m_bitboards[Color][QUEEN];
+    while (pieces)
+    {
+        mask |= get_rook_moves(__builtin_ctzll(pieces), occupancy);
+        pieces &= pieces - 1;
+    }
+    return mask;
 }
 
 uint64_t BitBoard::get_bishop_moves(uint8_t square, uint64_t blockers) const
 {
-    blockers &= BISHOP_RELEVANT_MASKS[square];
-    uint64_t key = (blockers * BISHOP_MAGICS[square]) >> (64 - BISHOP_SHIFTS[square]);
-    return bishop_moves[square][key];
+    return BISHOP_ATTACKS[BISHOP_OFFSETS[square] + bishop_key(square, blockers)];
 }
 
 uint64_t BitBoard::get_rook_moves(uint8_t square, uint64_t blockers) const
 {
-    blockers &= ROOK_RELEVANT_MASKS[square];
-    uint64_t key = (blockers * ROOK_MAGICS[square]) >> (64 - ROOK_SHIFTS[square]);
-    return rook_moves[square][key];
+    return ROOK_ATTACKS[ROOK_OFFSETS[square] + rook_key(square, blockers)];
 }
 
 std::ostream& operator<<(std::ostream& os, const BitBoard& board)
@@ -785,97 +757,6 @@ std::ostream& operator<<(std::ostream& os, const BitBoard& board)
     return os;
 }
 
-void BitBoard::generate_rook_moves()
-{
-    for (int8_t square = 0; square < 64; square++)
-    {
-        for (size_t index = 0; index < rook_moves[square].size(); index++)
-        {
-            uint64_t blockers = generate_blockerboard_with_index(index, ROOK_RELEVANT_MASKS[square]);
-            blockers &= ROOK_RELEVANT_MASKS[square];
-            uint64_t key = (blockers * ROOK_MAGICS[square]) >> (64 - ROOK_SHIFTS[square]);
-
-            uint64_t mask = 0;
-            // Y+
-            for (int8_t at = square; at < 64; at += 8)
-            {
-                mask |= (1ULL << at);
-                if (blockers & (1ULL << at))
-                    break;
-            }
-            // Y-
-            for (int8_t at = square; at >= 0; at -= 8)
-            {
-                mask |= (1ULL << at);
-                if (blockers & (1ULL << at))
-                    break;
-            }
-            // X+
-            for (int8_t at = square; true; at++)
-            {
-                mask |= (1ULL << at);
-                if (blockers & (1ULL << at) || ((1ULL << at) & FILE_H))
-                    break;
-            }
-            // X-
-            for (int8_t at = square; true; at--)
-            {
-                mask |= (1ULL << at);
-                if (blockers & (1ULL << at) || ((1ULL << at) & FILE_A))
-                    break;
-            }
-            mask ^= (1ULL << square);
-            rook_moves[square][key] = mask;
-        }
-    }
-}
-
-void BitBoard::generate_bishop_moves()
-{
-    for (int8_t square = 0; square < 64; square++)
-    {
-        for (size_t index = 0; index < bishop_moves[square].size(); index++)
-        {
-            uint64_t blockers = generate_blockerboard_with_index(index, BISHOP_RELEVANT_MASKS[square]);
-            blockers &= BISHOP_RELEVANT_MASKS[square];
-            uint64_t key = (blockers * BISHOP_MAGICS[square]) >> (64 - BISHOP_SHIFTS[square]);
-
-            uint64_t mask = 0;
-            // Y- X+
-            for (int8_t at = square; true; at = at - 8 + 1)
-            {
-                mask |= (1ULL << at);
-                if (blockers & (1ULL << at) || ((1ULL << at) & (FILE_H | ROW_1)))
-                    break;
-            }
-            // Y+ X+
-            for (int8_t at = square; true; at = at + 8 + 1)
-            {
-                mask |= (1ULL << at);
-                if (blockers & (1ULL << at) || ((1ULL << at) & (FILE_H | ROW_8)))
-                    break;
-            }
-            // Y+ X-
-            for (int8_t at = square; true; at = at + 8 - 1)
-            {
-                mask |= (1ULL << at);
-                if (blockers & (1ULL << at) || ((1ULL << at) & (FILE_A | ROW_8)))
-                    break;
-            }
-            // Y- X-
-            for (int8_t at = square; true; at = at - 8 - 1)
-            {
-                mask |= (1ULL << at);
-                if (blockers & (1ULL << at) || ((1ULL << at) & (FILE_A | ROW_1)))
-                    break;
-            }
-
-            mask ^= (1ULL << square);
-            bishop_moves[square][key] = mask;
-        }
-    }
-}
-
 bool BitBoard::isSquareAttacked(uint8_t square, uint8_t attacker_color) const
 {
     uint64_t all_pieces = allPieces();
@@ -890,14 +771,26 @@ bool BitBoard::isSquareAttacked(uint8_t square, uint8_t attacker_color) const
     return false;
 }
 
+/* Pieces of both colors attacking a square, with sliders seeing through everything missing from occupancy */
+uint64_t BitBoard::attackersTo(uint8_t square, uint64_t occupancy) const
+{
+    uint64_t bit = 1ULL << square;
+    uint64_t white_pawns = pawn_attacks_west<BLACK>(bit) | pawn_attacks_east<BLACK>(bit);
+    uint64_t black_pawns = pawn_attacks_west<WHITE>(bit) | pawn_attacks_east<WHITE>(bit);
+    return  (white_pawns & m_bitboards[WHITE][PAWN]) | (black_pawns & m_bitboards[BLACK][PAWN])
+            | (KNIGHT_MOVES[square] & (m_bitboards[WHITE][KNIGHT] | m_bitboards[BLACK][KNIGHT]))
+            | (KING_MOVES[square] & (m_bitboards[WHITE][KING] | m_bitboards[BLACK][KING]))
+            | (get_bishop_moves(square, occupancy) & (m_bitboards[WHITE][BISHOP] | m_bitboards[WHITE][QUEEN] | m_bitboards[BLACK][BISHOP] | m_bitboards[BLACK][QUEEN]))
+            | (get_rook_moves(square, occupancy) & (m_bitboards[WHITE][ROOK] | m_bitboards[WHITE][QUEEN] | m_bitboards[BLACK][ROOK] | m_bitboards[BLACK][QUEEN]));
+}
+
 uint64_t BitBoard::squareAttackers(uint8_t square, uint8_t attacker_color) const
 {
     uint64_t all_pieces = allPieces();
-    uint64_t pawnAttacks = 0;
-    if (((1ULL << square) & FILE_A) == 0)
-        pawnAttacks |= (1ULL << (square + (attacker_color == WHITE ? 8 : -8) - 1));
-    if (((1ULL << square) & FILE_H) == 0)
-        pawnAttacks |= (1ULL << (square + (attacker_color == WHITE ? 8 : -8) + 1));
+    // Pawns attacking the square stand where a pawn of the other color on it would attack
+    uint64_t bit = 1ULL << square;
+    uint64_t pawnAttacks = attacker_color == WHITE ? pawn_attacks_west<BLACK>(bit) | pawn_attacks_east<BLACK>(bit)
+                                                   : pawn_attacks_west<WHITE>(bit) | pawn_attacks_east<WHITE>(bit);
     return  (pawnAttacks & m_bitboards[attacker_color][PAWN])
             | (KNIGHT_MOVES[square] & m_bitboards[attacker_color][KNIGHT])
             | (KING_MOVES[square] & m_bitboards[attacker_color][KING])
@@ -1071,6 +964,43 @@ void precomputedBishopShifts()
 /*                                    Magic                                   */
 /* -------------------------------------------------------------------------- */
 
+/* PEXT only pays off when the CPU has BMI2 and runs it natively: AMD before Zen 3 microcodes it (~250 cycles) */
+SliderBackend detect_slider_backend()
+{
+#ifdef CHESS_HAS_PEXT
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) || !(ebx & bit_BMI2))
+        return MAGIC_BACKEND;
+    __get_cpuid(0, &eax, &ebx, &ecx, &edx);
+    bool amd = ebx == signature_AMD_ebx && ecx == signature_AMD_ecx && edx == signature_AMD_edx;
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+    uint32_t family = ((eax >> 8) & 0xF) + ((eax >> 20) & 0xFF);
+    if (amd && family < 0x19)
+        return MAGIC_BACKEND;
+    return PEXT_BACKEND;
+#else
+    return MAGIC_BACKEND;
+#endif
+}
+
+/* Switches the slider attack lookups to a backend and rebuilds the shared tables in its index order.
+** Returns false if the CPU cannot run it. Not thread safe, only call it while nothing is searching. */
+bool set_slider_backend(SliderBackend backend)
+{
+#ifdef CHESS_HAS_PEXT
+    unsigned int eax, ebx, ecx, edx;
+    if (backend == PEXT_BACKEND && (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) || !(ebx & bit_BMI2)))
+        return false;
+#else
+    if (backend == PEXT_BACKEND)
+        return false;
+#endif
+    slider_backend = backend;
+    generate_rook_moves();
+    generate_bishop_moves();
+    return true;
+}
+
 /* Generates a unique blocker board by masking some bits in the mask passed in parameter. Each index will give a unique blocker board. */
 uint64_t generate_blockerboard_with_index(int index, uint64_t blockermask)
 {
@@ -1088,6 +1018,97 @@ uint64_t generate_blockerboard_with_index(int index, uint64_t blockermask)
     return blockerboard;
 }
 
+/* Fills the shared rook attack table for every square and every blocker board */
+void generate_rook_moves()
+{
+    for (int8_t square = 0; square < 64; square++)
+    {
+        for (size_t index = 0; index < (1U << ROOK_SHIFTS[square]); index++)
+        {
+            uint64_t blockers = generate_blockerboard_with_index(index, ROOK_RELEVANT_MASKS[square]);
+            uint64_t key = rook_key(square, blockers);
+
+            uint64_t mask = 0;
+            // Y+
+            for (int8_t at = square; at < 64; at += 8)
+            {
+                mask |= (1ULL << at);
+                if (blockers & (1ULL << at))
+                    break;
+            }
+            // Y-
+            for (int8_t at = square; at >= 0; at -= 8)
+            {
+                mask |= (1ULL << at);
+                if (blockers & (1ULL << at))
+                    break;
+            }
+            // X+
+            for (int8_t at = square; true; at++)
+            {
+                mask |= (1ULL << at);
+                if (blockers & (1ULL << at) || ((1ULL << at) & FILE_H))
+                    break;
+            }
+            // X-
+            for (int8_t at = square; true; at--)
+            {
+                mask |= (1ULL << at);
+                if (blockers & (1ULL << at) || ((1ULL << at) & FILE_A))
+                    break;
+            }
+            mask ^= (1ULL << square);
+            ROOK_ATTACKS[ROOK_OFFSETS[square] + key] = mask;
+        }
+    }
+}
+
+/* Fills the shared bishop attack table for every square and every blocker board */
+void generate_bishop_moves()
+{
+    for (int8_t square = 0; square < 64; square++)
+    {
+        for (size_t index = 0; index < (1U << BISHOP_SHIFTS[square]); index++)
+        {
+            uint64_t blockers = generate_blockerboard_with_index(index, BISHOP_RELEVANT_MASKS[square]);
+            uint64_t key = bishop_key(square, blockers);
+
+            uint64_t mask = 0;
+            // Y- X+
+            for (int8_t at = square; true; at = at - 8 + 1)
+            {
+                mask |= (1ULL << at);
+                if (blockers & (1ULL << at) || ((1ULL << at) & (FILE_H | ROW_1)))
+                    break;
+            }
+            // Y+ X+
+            for (int8_t at = square; true; at = at + 8 + 1)
+            {
+                mask |= (1ULL << at);
+                if (blockers & (1ULL << at) || ((1ULL << at) & (FILE_H | ROW_8)))
+                    break;
+            }
+            // Y+ X-
+            for (int8_t at = square; true; at = at + 8 - 1)
+            {
+                mask |= (1ULL << at);
+                if (blockers & (1ULL << at) || ((1ULL << at) & (FILE_A | ROW_8)))
+                    break;
+            }
+            // Y- X-
+            for (int8_t at = square; true; at = at - 8 - 1)
+            {
+                mask |= (1ULL << at);
+                if (blockers & (1ULL << at) || ((1ULL << at) & (FILE_A | ROW_1)))
+                    break;
+            }
+
+            mask ^= (1ULL << square);
+            BISHOP_ATTACKS[BISHOP_OFFSETS[square] + key] = mask;
+        }
+    }
+}
+
 /* -------------------------------------------------------------------------- */
 /*                                    Utils                                   */
 /* -------------------------------------------------------------------------- */
@@ -1103,6 +1124,19 @@ uint8_t countBits(uint64_t n)
     return count;
 }
 
+/* Coordinate notation of a move, e.g. e2e4 or e7e8q */
+std::string move_to_string(uint16_t move)
+{
+    static const char promotionChars[] = { 0, 0, 'n', 'b', 'r', 'q' };
+    uint8_t from = (move >> 6) & 0b111111;
+    uint8_t to = move & 0b111111;
+    std::string result = { static_cast<char>('a' + from % 8), static_cast<char>('8' - from / 8),
+                           static_cast<char>('a' + to % 8), static_cast<char>('8' - to / 8) };
+    if (move >> 12)
+        result += promotionChars[move >> 12];
+    return result;
+}
+
 /* Prints a bitboard in a human readable format */
 void printBitboard(uint64_t bitboard)
 {
@@ -62,7 +62,7 @@ void BitBoardState::update()
     if (sf::Keyboard::isKeyPressed(sf::Keyboard::Space) && heldSquare == 255 && !hasToRelease)
     {
         uint16_t move = computer.getBestMove(bitboard);
-        bitboard.movePiece((move >> 6) & 0b111111, move & 0b111111, move >> 12);
+        computer.playMove(bitboard, move);
         hasToRelease = true;
         return;
     }
@@ -90,7 +90,7 @@ void BitBoardState::update()
             auto moves = bitboard.get_moves(bitboard.player_to_move());
             uint8_t promotion_piece = ((1ULL << index) & (ROW_8 | ROW_1)) && bitboard.at(heldSquare) == PAWN ? QUEEN : 0;
             if (std::find(moves.begin(), moves.end(), (heldSquare << 6) | (index) | (promotion_piece << 12)) != moves.end())
-                bitboard.movePiece(heldSquare, index, promotion_piece);
+                computer.playMove(bitboard, (heldSquare << 6) | index | (promotion_piece << 12));
             heldSquare = 255;
         }
         else
@@ -34,15 +34,29 @@ Computer::Computer()
 {
     m_depth = 6;
     m_timeToPlay = 1 * 1000;
-    m_killerMoves.resize(m_depth, {0, 0});
+    m_timeControl = { 0, 0, 0 };
+    m_nodes = 0;
+    m_qnodes = 0;
+    m_cutoffs = 0;
+    m_firstMoveCutoffs = 0;
+    m_copyMake = false;
+    m_threadCount = 1;
+    m_stop = false;
 }
 
 Computer::Computer(uint8_t depth, const std::string& openingBook)
 {
-    m_depth = depth;
+    m_depth = std::min<uint8_t>(depth, MAX_DEPTH);
     m_openingBook = OpeningBook(openingBook);
     m_timeToPlay = 1 * 1000;
-    m_killerMoves.resize(m_depth, {0, 0});
+    m_timeControl = { 0, 0, 0 };
+    m_nodes = 0;
+    m_qnodes = 0;
+    m_cutoffs = 0;
+    m_firstMoveCutoffs = 0;
+    m_copyMake = false;
+    m_threadCount = 1;
+    m_stop = false;
 }
 
 Computer::Computer(const Computer& other)
@@ -56,64 +70,27 @@ Computer& Computer::operator=(const Computer& other)
     m_openingBook = other.m_openingBook;
     m_transpositionTable = other.m_transpositionTable;
     m_timeToPlay = other.m_timeToPlay;
-    m_killerMoves = other.m_killerMoves;
+    m_timeControl = other.m_timeControl;
+    m_nodes = other.m_nodes;
+    m_qnodes = other.m_qnodes;
+    m_cutoffs = other.m_cutoffs;
+    m_firstMoveCutoffs = other.m_firstMoveCutoffs;
+    m_copyMake = other.m_copyMake;
+    m_threadCount = other.m_threadCount;
+    m_gameHistory = other.m_gameHistory;
+    m_stop = false;
     return *this;
 }
 
-uint64_t Computer::hash(const BitBoard& board) const
+/* Resizes the transposition table, which empties it */
+void Computer::setHashSize(size_t megabytes)
 {
-    // Piece
-    uint64_t pieces = 0;
-    for (int8_t i = 0; i < 64; i++)
-    {
-        uint8_t piece = board.m_pieces[i];
-        if (piece == 0)
-            continue;
-        uint8_t piece_zobrist_index = 0;
-        switch (piece)
-        {
-        case PAWN:
-            piece_zobrist_index = (board.m_bitboards[BLACK][PAWN] & (1ULL << i)) ? 0 : 1;
-            break;
-        case KNIGHT:
-            piece_zobrist_index = (board.m_bitboards[BLACK][KNIGHT] & (1ULL << i)) ? 2 : 3;
-            break;
-        case BISHOP:
-            piece_zobrist_index = (board.m_bitboards[BLACK][BISHOP] & (1ULL << i)) ? 4 : 5;
-            break;
-        case ROOK:
-            piece_zobrist_index = (board.m_bitboards[BLACK][ROOK] & (1ULL << i)) ? 6 : 7;
-            break;
-        case QUEEN:
-            piece_zobrist_index = (board.m_bitboards[BLACK][QUEEN] & (1ULL << i)) ? 8 : 9;
-            break;
-        case KING:
-            piece_zobrist_index = (board.m_bitboards[BLACK][KING] & (1ULL << i)) ? 10 : 11;
-            break;
-        }
-
-        pieces ^= ZOBRIST_KEYS[64 * piece_zobrist_index + 8 * (7 - i / 8) + (i % 8)];
-    }
-
-    // Castling
-    uint64_t castling = ((board.m_castling_rights & WK) ? ZOBRIST_KEYS[768] : 0) ^ ((board.m_castling_rights & WQ) ? ZOBRIST_KEYS[769] : 0)
-                        ^ ((board.m_castling_rights & BK) ? ZOBRIST_KEYS[770] : 0) ^ ((board.m_castling_rights & BQ) ? ZOBRIST_KEYS[771] : 0);
-
-    // En passant
-    uint64_t en_passant = 0;
-    if (board.m_en_passant_square != 255)
-    {
-        uint8_t en_passant_pawn_square = board.m_en_passant_square + (board.player_to_move() == WHITE ? 8 : -8);
-        bool can_en_passant = ((ROWS[en_passant_pawn_square / 8] & ((1ULL << (en_passant_pawn_square + 1)) | (1ULL << (en_passant_pawn_square - 1)))
-                                    & board.m_bitboards[board.player_to_move()][PAWN]) != 0);
-        en_passant = can_en_passant ? ZOBRIST_KEYS[772 + (board.m_en_passant_square % 8)] : 0;
-    }
-
-    // Side to move
-    uint64_t side_to_move = (board.player_to_move() == WHITE ? ZOBRIST_KEYS[780] : 0);
+    m_transpositionTable.resize(megabytes);
+}
 
-    // Hash
-    return (pieces ^ castling ^ en_passant ^ side_to_move);
+uint64_t Computer::hash(const BitBoard& board) const
+{
+    return board.computeKey();
 }
 
 int Computer::evaluate(const BitBoard& board) const
@@ -166,128 +143,402 @@ int Computer::evaluate(const BitBoard& board) const
     return score;
 }
 
-int Computer::quiescence(BitBoard& board, int alpha, int beta, int8_t color)
+// Late move reductions by depth and move number: ln(depth) * ln(moveCount) / 2, rounded
+static std::array<std::array<uint8_t, 64>, 64> generate_lmr_reductions()
+{
+    std::array<std::array<uint8_t, 64>, 64> reductions = {};
+    for (int depth = 1; depth < 64; depth++)
+        for (int moveCount = 1; moveCount < 64; moveCount++)
+            reductions[depth][moveCount] = static_cast<uint8_t>(0.5 + std::log(depth) * std::log(moveCount) / 2);
+    return reductions;
+}
+
+static const std::array<std::array<uint8_t, 64>, 64> LMR_REDUCTIONS = generate_lmr_reductions();
+
+/* Gravity update: the closer an entry gets to MAX_HISTORY, the less a bonus moves it, so it never saturates */
+static void update_history(int16_t& entry, int bonus)
 {
-    int stand_pat = color * evaluate(board);
-    if (stand_pat >= beta)
-        return beta;
-    if (stand_pat >= alpha)
-        alpha = stand_pat;
+    entry += bonus - entry * std::abs(bonus) / MAX_HISTORY;
+}
+
+/* The table stores mate scores as the distance to mate from the stored position instead of from the root,
+   so that they stay right when the position is reached again at another ply */
+static int score_to_tt(int score, uint8_t ply)
+{
+    return score >= MATE_BOUND ? score + ply : (score <= -MATE_BOUND ? score - ply : score);
+}
+
+static int score_from_tt(int score, uint8_t ply)
+{
+    return score >= MATE_BOUND ? score - ply : (score <= -MATE_BOUND ? score + ply : score);
+}
+
+/* Centipawns, or moves to mate, negative when getting mated */
+static std::string score_to_string(int score)
+{
+    if (score >= MATE_BOUND)
+        return "mate " + std::to_string((MATE_SCORE - score + 1) / 2);
+    if (score <= -MATE_BOUND)
+        return "mate -" + std::to_string((MATE_SCORE + score) / 2);
+    return std::to_string(score);
+}
+
+/* Plays the move and returns the board to search it on: the same board with make/unmake, the next ply's copy with copy-make */
+BitBoard& Computer::makeMove(SearchThread& thread, BitBoard& board, uint16_t move, uint8_t ply, uint64_t& encodedMove)
+{
+    if (!m_copyMake)
+    {
+        encodedMove = board.movePiece((move >> 6) & 0b111111, move & 0b111111, move >> 12);
+        return board;
+    }
+    BitBoard& child = thread.boardStack[ply + 1];
+    child = board;
+    child.movePiece((move >> 6) & 0b111111, move & 0b111111, move >> 12);
+    return child;
+}
+
+/* Takes back a move played by makeMove, the parent board is untouched with copy-make */
+void Computer::unmakeMove(BitBoard& board, uint64_t encodedMove)
+{
+    if (!m_copyMake)
+        board.undoMove(encodedMove);
+}
+
+/* Same as makeMove for a null move */
+BitBoard& Computer::makeNullMove(SearchThread& thread, BitBoard& board, uint8_t ply, uint64_t& encodedMove)
+{
+    if (!m_copyMake)
+    {
+        encodedMove = board.makeNullMove();
+        return board;
+    }
+    BitBoard& child = thread.boardStack[ply + 1];
+    child = board;
+    child.makeNullMove();
+    return child;
+}
+
+void Computer::unmakeNullMove(BitBoard& board, uint64_t encodedMove)
+{
+    if (!m_copyMake)
+        board.undoNullMove(encodedMove);
+}
+
+/* Polled every 2048 nodes, cheap enough to leave in the search. Only the main thread looks at the clock, and its
+   first iteration always completes so there is a move to play */
+bool Computer::timeUp(SearchThread& thread)
+{
+    if (thread.id == 0 && (thread.nodes.load(std::memory_order_relaxed) & 2047) == 0 && thread.rootDepth > 1
+        && !m_stop.load(std::memory_order_relaxed) && m_timeManager.hardLimitReached())
+        m_stop = true;
+    return m_stop.load(std::memory_order_relaxed);
+}
+
+/* Fifty moves without a capture or a pawn move, or a position already seen since the last one. A single repetition is
+   enough: whatever the side to move does from there, the other one can repeat it again. Only every other position
+   since the last irreversible move can be the same one, with the same side to move */
+bool Computer::isDraw(const SearchThread& thread, const BitBoard& board, uint8_t ply) const
+{
+    if (board.m_halfmove_clock >= 100)
+        return true;
+    size_t index = thread.gamePly + ply;
+    size_t distance = std::min<size_t>(board.m_halfmove_clock, index);
+    for (size_t i = 4; i <= distance; i += 2)
+        if (thread.keys[index - i] == board.m_key)
+            return true;
+    return false;
+}
+
+// Margin over the captured piece value a capture needs to be able to raise alpha in quiescence,
+// for the positional swing the static evaluation does not see
+constexpr int DELTA_MARGIN = 200;
+
+/* Captures only, on top of the static evaluation the side to move can always settle for. In check there is no such
+   evaluation: every evasion is searched and having none is mate */
+int Computer::quiescence(SearchThread& thread, BitBoard& board, uint8_t ply, int alpha, int beta, int8_t color)
+{
+    thread.nodes.store(thread.nodes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    thread.qnodes++;
+    if (timeUp(thread))
+        return 0;
 
     uint8_t player_to_move = board.player_to_move();
-    std::vector<uint16_t> moves = board.get_capture_moves(player_to_move);
-    
-    if (moves.size() == 0)
-        return color * evaluate(board);
+    bool inCheck = board.squareAttackers(__builtin_ctzll(board.m_bitboards[player_to_move][KING]), !player_to_move) != 0;
+    if (ply >= MAX_PLY - 1)
+        return inCheck ? 0 : color * evaluate(board);
 
-    std::sort(moves.begin(), moves.end(), [&board, player_to_move, this](uint16_t a, uint16_t b) {
-        int16_t score = 0;
-        int8_t a_to = a & 0b111111;
-        int8_t a_from = (a >> 6) & 0b111111;
-        int8_t b_from = (b >> 6) & 0b111111;
-        int8_t b_to = b & 0b111111;
+    int startAlpha = alpha;
 
-        score += (PIECE_VALUES[board.at(a_to)]) - (PIECE_VALUES[board.m_pieces[a_from]] / 10);
-        score -= (PIECE_VALUES[board.at(b_to)]) - (PIECE_VALUES[board.m_pieces[b_from]] / 10);
+    // Any entry is deep enough here, quiescence ones included
+    uint64_t key = board.m_key;
+    TranspositionTableData ttData = { 0, 0, 0, EXACT };
+    if (m_transpositionTable.probe(key, ttData))
+    {
+        ttData.score = score_from_tt(ttData.score, ply);
+        if (ttData.type == EXACT || (ttData.type == LOWERBOUND && ttData.score >= beta) || (ttData.type == UPPERBOUND && ttData.score <= alpha))
+            return ttData.score;
+    }
 
-        score += ((board.m_last_move_to == a_to) - (board.m_last_move_to == b_to)) * 1001;
+    int staticEval = 0;
+    if (!inCheck)
+    {
+        staticEval = color * evaluate(board);
+        if (staticEval >= beta)
+            return beta;
+        if (staticEval >= alpha)
+            alpha = staticEval;
+    }
 
-        return score > 0;
-    });
+    MovePicker picker = inCheck ? MovePicker(board, ttData.move, { 0, 0 }, 0, thread.history) : MovePicker(board, ttData.move);
+    uint16_t move;
+    int moveCount = 0;
 
-    int bestScore = -std::numeric_limits<int>::max();
-    for (uint16_t move : moves)
+    uint16_t bestMove = 0;
+    while ((move = picker.next()) != 0)
     {
-        uint64_t encodedMove = board.movePiece((move >> 6) & 0b111111, move & 0b111111, move >> 12);
-        int moveValue = -quiescence(board, -beta, -alpha, -color);
-        alpha = std::max(alpha, moveValue);
-        if (moveValue > bestScore)
-            bestScore = moveValue;
-        if (alpha >= beta)
+        moveCount++;
+
+        // Delta pruning: even winning the captured piece for free would not get back to alpha
+        if (!inCheck && (move >> 12) == 0)
         {
-            board.undoMove(encodedMove);
-            break;
+            uint8_t victim = board.at(move & 0b111111) ? board.at(move & 0b111111) : PAWN;
+            if (staticEval + PIECE_VALUES[victim] + DELTA_MARGIN <= alpha)
+                continue;
         }
-        board.undoMove(encodedMove);
+
+        uint64_t encodedMove = 0;
+        int moveValue = -quiescence(thread, makeMove(thread, board, move, ply, encodedMove), ply + 1, -beta, -alpha, -color);
+        unmakeMove(board, encodedMove);
+        if (m_stop.load(std::memory_order_relaxed))
+            return 0;
+        if (moveValue > alpha)
+        {
+            alpha = moveValue;
+            bestMove = move;
+        }
+        if (alpha >= beta)
+            break;
     }
 
+    if (inCheck && moveCount == 0)
+        return -MATE_SCORE + ply;
+
+    TranspositionTableNodeType type = alpha >= beta ? LOWERBOUND : (alpha > startAlpha ? EXACT : UPPERBOUND);
+    m_transpositionTable.store(key, bestMove, 0, score_to_tt(alpha, ply), type);
     return alpha;
 }
 
-std::pair<int, uint16_t> Computer::negamax(BitBoard& board, uint8_t depth, int alpha, int beta, int8_t color)
+// Frontier pruning margins in centipawns, by remaining depth: how far the static evaluation may be from the window
+// before the search trusts it. Reverse futility: above beta by REVERSE_FUTILITY_MARGIN per ply left.
+// Futility: a quiet move below alpha by FUTILITY_MARGINS[depth]. Razoring: the position below alpha by RAZORING_MARGINS[depth].
+constexpr uint8_t REVERSE_FUTILITY_DEPTH = 6;
+constexpr int REVERSE_FUTILITY_MARGIN = 120;
+constexpr std::array<int, 4> FUTILITY_MARGINS = { 0, 200, 300, 500 };
+constexpr std::array<int, 2> RAZORING_MARGINS = { 0, 600 };
+
+// Singular extensions: from this depth, the table move is extended when every other move fails low by
+// SINGULAR_MARGIN per ply under its score on a half depth search
+constexpr uint8_t SINGULAR_DEPTH = 8;
+constexpr int SINGULAR_MARGIN = 2;
+
+template <NodeType Type>
+std::pair<int, uint16_t> Computer::negamax(SearchThread& thread, BitBoard& board, uint8_t depth, uint8_t ply, int alpha, int beta, int8_t color)
 {
-    static uint64_t tbUsed = 0;
-    static uint64_t positions = 0;
+    constexpr bool rootNode = Type == ROOT_NODE;
+    constexpr bool pvNode = Type != NON_PV_NODE;
+
+    if (pvNode)
+        thread.pvLength[ply] = ply;
+    if (depth == 0 || ply >= MAX_PLY - 1)
+        return std::make_pair(quiescence(thread, board, ply, alpha, beta, color), 0);
 
-    if (depth == 0)
-        return std::make_pair(quiescence(board, alpha, beta, color), 0);
+    thread.nodes.store(thread.nodes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (timeUp(thread))
+        return std::make_pair(0, 0);
+
+    SearchStack& stack = thread.stack[ply];
+    // Singular extension search of this same node: the table is neither trusted nor written, since a move is missing
+    uint16_t excludedMove = stack.excludedMove;
+
+    // Before anything else, the transposition table included: a draw depends on the path, not only on the position
+    thread.keys[thread.gamePly + ply] = board.m_key;
+    if (!rootNode && isDraw(thread, board, ply))
+        return std::make_pair(0, 0);
+
+    // Mate distance pruning: even mating right away, no line from here beats a shorter mate already found elsewhere
+    if (!rootNode)
+    {
+        alpha = std::max(alpha, -MATE_SCORE + ply);
+        beta = std::min(beta, MATE_SCORE - ply - 1);
+        if (alpha >= beta)
+            return std::make_pair(alpha, 0);
+    }
 
     int startAlpha = alpha;
 
-    uint64_t key = hash(board);
-    auto ttMoveIt = m_transpositionTable.find(key);
-    if (ttMoveIt != m_transpositionTable.end() && ttMoveIt->second.depth >= depth)
+    uint64_t key = board.m_key;
+    TranspositionTableData ttData = { 0, 0, 0, EXACT };
+    // Principal variation nodes always search: the root so that it returns a move of this search, and all of them
+    // so that the principal variation goes on past them instead of stopping at a table hit
+    bool ttHit = m_transpositionTable.probe(key, ttData);
+    ttData.score = score_from_tt(ttData.score, ply);
+    if (!pvNode && ttHit && ttData.depth >= depth && excludedMove == 0)
     {
-        tbUsed += 1;
-        if (ttMoveIt->second.type == EXACT)
-            return std::make_pair(ttMoveIt->second.score, ttMoveIt->second.move);
-        else if (ttMoveIt->second.type == LOWERBOUND)
-            alpha = std::max(alpha, ttMoveIt->second.score);
-        else if (ttMoveIt->second.type == UPPERBOUND)
-            beta = std::min(beta, ttMoveIt->second.score);
+        if (ttData.type == EXACT)
+            return std::make_pair(ttData.score, ttData.move);
+        else if (ttData.type == LOWERBOUND)
+            alpha = std::max(alpha, ttData.score);
+        else if (ttData.type == UPPERBOUND)
+            beta = std::min(beta, ttData.score);
 
         if (alpha >= beta)
-            return std::make_pair(ttMoveIt->second.score, ttMoveIt->second.move);
+            return std::make_pair(ttData.score, ttData.move);
+    }
+
+    // Still on the principal variation of the previous iteration: its move comes first, whatever the table says.
+    // Only the child reached through that move goes on following it
+    uint16_t pvMove = 0;
+    if (pvNode)
+    {
+        if (thread.followPv && ply < thread.previousPvLength)
+            pvMove = thread.previousPv[ply];
+        thread.followPv = false;
     }
 
     uint8_t player_to_move = board.player_to_move();
-    std::vector<uint16_t> moves = board.get_moves(player_to_move);
-    
-    if (moves.size() == 0)
+    bool inCheck = board.squareAttackers(__builtin_ctzll(board.m_bitboards[player_to_move][KING]), !player_to_move) != 0;
+    // In check the static evaluation means nothing, none of the pruning below relies on it then
+    int staticEval = inCheck ? 0 : color * evaluate(board);
+
+    // Reverse futility pruning: so far above beta that no move is expected to bring the score back under it
+    if (!pvNode && !inCheck && excludedMove == 0 && depth <= REVERSE_FUTILITY_DEPTH && beta < MATE_BOUND
+        && staticEval - REVERSE_FUTILITY_MARGIN * depth >= beta)
+        return std::make_pair(staticEval, 0);
+
+    // Razoring: so far below alpha that only captures could bring the score back, check that in quiescence
+    if (!pvNode && !inCheck && excludedMove == 0 && depth < RAZORING_MARGINS.size() && alpha > -MATE_BOUND
+        && staticEval + RAZORING_MARGINS[depth] <= alpha)
     {
-        if ((board.isSquareAttacked(__builtin_ctzll(board.m_bitboards[player_to_move][KING]), !player_to_move)))
-            return std::make_pair(color * (player_to_move == WHITE ? -32000 : 32000), 0);
-        else
+        int score = quiescence(thread, board, ply, alpha, alpha + 1, color);
+        if (m_stop.load(std::memory_order_relaxed))
             return std::make_pair(0, 0);
+        if (score <= alpha)
+            return std::make_pair(score, 0);
     }
 
-    std::sort(moves.begin(), moves.end(), [&board, player_to_move, &ttMoveIt, this, key, depth](uint16_t a, uint16_t b) {
-        int16_t score = 0;
-        int8_t a_to = a & 0b111111;
-        int8_t a_from = (a >> 6) & 0b111111;
-        int8_t b_from = (b >> 6) & 0b111111;
-        int8_t b_to = b & 0b111111;
-
-        if (board.isCapture(a))
-            score += (PIECE_VALUES[board.at(a_to)]) - (PIECE_VALUES[board.m_pieces[a_from]] / 10);
-        if (board.isCapture(b))
-            score -= (PIECE_VALUES[board.at(b_to)]) - (PIECE_VALUES[board.m_pieces[b_from]] / 10);
-
-        uint8_t a_square = (player_to_move == WHITE ? a_to : (7 - a_to / 8) * 8 + (a_to % 8));
-        uint8_t b_square = (player_to_move == WHITE ? b_to : (7 - b_to / 8) * 8 + (b_to % 8));
-        score += PIECE_TABLES[board.m_pieces[a_from] - 1][a_square] - PIECE_TABLES[board.m_pieces[b_from] - 1][b_square];
+    // Null move pruning: if passing the turn still fails high on a reduced search, a real move would too.
+    // Only on null window nodes, where a cutoff loses no principal variation. Not in check (passing would be illegal),
+    // not right after the opponent passed, and not with only pawns left where zugzwang makes passing better than any move
+    uint64_t pieces = board.m_bitboards[player_to_move][ALL] & ~(board.m_bitboards[player_to_move][PAWN] | board.m_bitboards[player_to_move][KING]);
+    if (!pvNode && !inCheck && excludedMove == 0 && thread.stack[ply - 1].currentMove != 0 && depth >= 3 && pieces
+        && beta < MATE_BOUND && staticEval >= beta)
+    {
+        uint8_t reduction = 3 + depth / 4 + std::min((staticEval - beta) / 200, 2);
+        uint64_t encodedMove = 0;
+        stack.currentMove = 0;
+        thread.stack[ply + 1].extensions = stack.extensions;
+        int score = -negamax<NON_PV_NODE>(thread, makeNullMove(thread, board, ply, encodedMove), std::max(0, depth - 1 - reduction), ply + 1,
+                                          -beta, -beta + 1, -color).first;
+        unmakeNullMove(board, encodedMove);
+        if (m_stop.load(std::memory_order_relaxed))
+            return std::make_pair(0, 0);
+        // A mate found after passing is not proven, only the cutoff is trusted
+        if (score >= beta)
+            return std::make_pair(score >= MATE_BOUND ? beta : score, 0);
+    }
 
-        score += ((board.m_last_move_to == a_to) - (board.m_last_move_to == b_to)) * 1001;
+    // Singular extension: a table move that fails high or is exact, while all the others fail low well under its score
+    // on a reduced search, is the only move holding the position and is worth one more ply
+    uint16_t singularMove = 0;
+    if (!rootNode && depth >= SINGULAR_DEPTH && excludedMove == 0 && ttHit && ttData.move != 0 && ttData.type != UPPERBOUND
+        && ttData.depth + 3 >= depth && std::abs(ttData.score) < MATE_BOUND && board.isLegal(ttData.move))
+    {
+        int singularBeta = ttData.score - SINGULAR_MARGIN * depth;
+        stack.excludedMove = ttData.move;
+        int score = negamax<NON_PV_NODE>(thread, board, depth / 2, ply, singularBeta - 1, singularBeta, color).first;
+        stack.excludedMove = 0;
+        if (m_stop.load(std::memory_order_relaxed))
+            return std::make_pair(0, 0);
+        if (score < singularBeta)
+            singularMove = ttData.move;
+    }
 
-        if (ttMoveIt != this->m_transpositionTable.end() && ttMoveIt->second.move == a)
-            score += 50;
-        if (ttMoveIt != this->m_transpositionTable.end() && ttMoveIt->second.move == b)
-            score -= 50;
+    // Futility pruning: near the leaves, quiet moves cannot make up for a static evaluation this far below alpha
+    bool futile = !inCheck && depth < FUTILITY_MARGINS.size() && alpha > -MATE_BOUND && alpha < MATE_BOUND
+                  && staticEval + FUTILITY_MARGINS[depth] <= alpha;
 
-        score += ((m_killerMoves[depth - 1][0] == a || m_killerMoves[depth - 1][0] == a) - (m_killerMoves[depth - 1][0] == b || m_killerMoves[depth - 1][0] == b)) * 40;
-        return score > 0;
-    });
+    uint8_t previousTo = board.m_last_move_to;
+    uint8_t previousPiece = previousTo < 64 ? board.at(previousTo) : 0;
+    MovePicker picker(board, pvMove != 0 ? pvMove : ttData.move, stack.killers, thread.counterMoves[previousPiece][previousTo % 64], thread.history);
+    uint16_t move;
+    int moveCount = 0;
+    MoveList quietsTried;
 
     int bestScore = -std::numeric_limits<int>::max();
     uint16_t bestMove = 0;
-    for (uint16_t move : moves)
+    while ((move = picker.next()) != 0)
     {
-        positions++;
-        uint64_t encodedMove = board.movePiece((move >> 6) & 0b111111, move & 0b111111, move >> 12);
-        auto moveValue = negamax(board, depth - 1, -beta, -alpha, -color);
+        if (move == excludedMove)
+            continue;
+        moveCount++;
+        bool quiet = !board.isCapture(move) && (move >> 12) == 0;
+        bool killer = move == stack.killers[0] || move == stack.killers[1];
+        uint64_t encodedMove = 0;
+        BitBoard& child = makeMove(thread, board, move, ply, encodedMove);
+        bool givesCheck = child.squareAttackers(__builtin_ctzll(child.m_bitboards[child.player_to_move()][KING]), player_to_move) != 0;
+
+        // The first move is always searched, so that a node where everything is pruned still has a score and is not taken for a mate
+        if (futile && moveCount > 1 && quiet && !givesCheck)
+        {
+            unmakeMove(board, encodedMove);
+            continue;
+        }
+
+        stack.currentMove = move;
+        if (pvNode)
+        {
+            thread.followPv = pvMove != 0 && move == pvMove;
+            thread.pvLength[ply + 1] = ply + 1;
+        }
+
+        // Check and singular extensions, as long as the path has not been extended by half the iteration depth yet
+        uint8_t extension = (givesCheck || move == singularMove) && stack.extensions < thread.rootDepth / 2 ? 1 : 0;
+        thread.stack[ply + 1].extensions = stack.extensions + extension;
+        uint8_t newDepth = depth - 1 + extension;
+
+        // Principal variation search: the first move gets the full window, the others only have to be proven
+        // worse with a null window, and are searched again with the full window when that fails
+        std::pair<int, uint16_t> moveValue;
+        if (pvNode && moveCount == 1)
+            moveValue = negamax<PV_NODE>(thread, child, newDepth, ply + 1, -beta, -alpha, -color);
+        else
+        {
+            // Late move reductions: quiet moves ordered late are probably bad, prove it at a reduced depth first
+            // and only search them fully if they beat alpha
+            uint8_t reduction = 0;
+            if (depth >= 3 && moveCount >= 4 && quiet && !killer && !inCheck && !givesCheck)
+                reduction = std::min<uint8_t>(LMR_REDUCTIONS[std::min<int>(depth, 63)][std::min(moveCount, 63)], depth - 2);
+
+            moveValue = negamax<NON_PV_NODE>(thread, child, newDepth - reduction, ply + 1, -alpha - 1, -alpha, -color);
+            if (reduction > 0 && -moveValue.first > alpha && !m_stop.load(std::memory_order_relaxed))
+                moveValue = negamax<NON_PV_NODE>(thread, child, newDepth, ply + 1, -alpha - 1, -alpha, -color);
+            if (pvNode && -moveValue.first > alpha && -moveValue.first < beta && !m_stop.load(std::memory_order_relaxed))
+                moveValue = negamax<PV_NODE>(thread, child, newDepth, ply + 1, -beta, -alpha, -color);
+        }
+        unmakeMove(board, encodedMove);
+        if (m_stop.load(std::memory_order_relaxed))
+            return std::make_pair(0, 0);
         moveValue.first *= -1;
         if (moveValue.first > alpha)
+        {
             alpha = moveValue.first;
+            if (pvNode)
+            {
+                thread.pv[ply][ply] = move;
+                std::copy(thread.pv[ply + 1].begin() + ply + 1, thread.pv[ply + 1].begin() + thread.pvLength[ply + 1], thread.pv[ply].begin() + ply + 1);
+                thread.pvLength[ply] = thread.pvLength[ply + 1];
+            }
+        }
         if (moveValue.first > bestScore)
         {
             bestScore = moveValue.first;
@@ -295,49 +546,197 @@ std::pair<int, uint16_t> Computer::negamax(BitBoard& board, uint8_t depth, int a
         }
         if (alpha >= beta)
         {
-            if (!board.isCapture(move))
+            thread.cutoffs++;
+            thread.firstMoveCutoffs += (moveCount == 1);
+            if (quiet)
             {
-                m_killerMoves[depth - 1][1] = m_killerMoves[depth - 1][0];
-                m_killerMoves[depth - 1][0] = move;
+                if (move != stack.killers[0])
+                {
+                    stack.killers[1] = stack.killers[0];
+                    stack.killers[0] = move;
+                }
+                if (previousPiece != 0)
+                    thread.counterMoves[previousPiece][previousTo] = move;
+
+                int bonus = std::min(32 * depth * depth, 1200);
+                update_history(thread.history[player_to_move][(move >> 6) & 0b111111][move & 0b111111], bonus);
+                for (uint16_t tried : quietsTried)
+                    update_history(thread.history[player_to_move][(tried >> 6) & 0b111111][tried & 0b111111], -bonus);
             }
-            board.undoMove(encodedMove);
             break;
         }
-        board.undoMove(encodedMove);
+        if (quiet)
+            quietsTried.push_back(move);
     }
 
-    TranspositionTableData ttData = { bestMove, depth, alpha, (bestScore <= startAlpha ? UPPERBOUND : (bestScore >= beta ? LOWERBOUND : EXACT)), 0 };
-    if (ttMoveIt == m_transpositionTable.end() || ttMoveIt->second.depth <= depth)
-        m_transpositionTable[key] = ttData;
+    // Without the excluded move there may be nothing left, which is no mate: the excluded move is then singular
+    if (excludedMove != 0)
+        return std::make_pair(alpha, bestMove);
 
-    if (depth == m_depth)
+    if (moveCount == 0)
     {
-        if (positions != 0)
-            std::cout << "Transposition table usage: " << (tbUsed / ((float)positions)) * 100 << "%" << std::endl;
-        tbUsed = 0;
-        positions = 0;
+        if (inCheck)
+            return std::make_pair(-MATE_SCORE + ply, 0);
+        else
+            return std::make_pair(0, 0);
     }
 
+    m_transpositionTable.store(key, bestMove, depth, score_to_tt(alpha, ply), (bestScore <= startAlpha ? UPPERBOUND : (bestScore >= beta ? LOWERBOUND : EXACT)));
+
     return std::make_pair(alpha, bestMove);
 }
 
+// Half width of the first root window, in centipawns, and the width past which the window is dropped
+constexpr int ASPIRATION_WINDOW = 25;
+constexpr int MAX_ASPIRATION_WINDOW = 500;
+
+// Helper threads skip some depths, each with its own pattern, so that they are not all searching the same depth
+constexpr std::array<uint8_t, 20> SKIP_SIZE = { 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4 };
+constexpr std::array<uint8_t, 20> SKIP_PHASE = { 0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7 };
+
+/* Iterative deepening loop of one thread. The main thread manages the time and stops the helpers when it is done */
+void Computer::iterativeDeepening(SearchThread& thread)
+{
+    // Each iteration fills the table and the killers that order the next one,
+    // an iteration cut by the hard limit is thrown away and the move of the last complete one is kept
+    int8_t color = thread.boardStack[0].player_to_move() == WHITE ? 1 : -1;
+    uint8_t maxDepth = std::min<uint8_t>(m_depth, MAX_DEPTH);
+    for (thread.rootDepth = 1; thread.rootDepth <= maxDepth; thread.rootDepth++)
+    {
+        if (thread.id != 0)
+        {
+            uint8_t i = (thread.id - 1) % SKIP_SIZE.size();
+            if (((thread.rootDepth + SKIP_PHASE[i]) / SKIP_SIZE[i]) % 2)
+                continue;
+        }
+
+        // Aspiration window around the previous score, widened on the failing side until the score falls inside
+        int alpha = -std::numeric_limits<int>::max();
+        int beta = std::numeric_limits<int>::max();
+        int delta = ASPIRATION_WINDOW;
+        if (thread.completedDepth >= 3)
+        {
+            alpha = thread.bestScore - delta;
+            beta = thread.bestScore + delta;
+        }
+
+        std::pair<int, uint16_t> result;
+        while (true)
+        {
+            thread.followPv = true;
+            result = negamax<ROOT_NODE>(thread, thread.boardStack[0], thread.rootDepth, 0, alpha, beta, color);
+            if (m_stop.load(std::memory_order_relaxed))
+                break;
+            delta += delta / 2;
+            if (result.first <= alpha && alpha != -std::numeric_limits<int>::max())
+                alpha = delta > MAX_ASPIRATION_WINDOW ? -std::numeric_limits<int>::max() : result.first - delta;
+            else if (result.first >= beta && beta != std::numeric_limits<int>::max())
+                beta = delta > MAX_ASPIRATION_WINDOW ? std::numeric_limits<int>::max() : result.first + delta;
+            else
+                break;
+        }
+        if (m_stop.load(std::memory_order_relaxed))
+            break;
+        thread.completedDepth = thread.rootDepth;
+        thread.bestMove = result.second;
+        thread.bestScore = result.first;
+        std::copy(thread.pv[0].begin(), thread.pv[0].begin() + thread.pvLength[0], thread.previousPv.begin());
+        thread.previousPvLength = thread.pvLength[0];
+
+        if (thread.id == 0)
+        {
+            uint64_t nodes = 0;
+            for (auto& searchThread : m_threads)
+                nodes += searchThread->nodes.load(std::memory_order_relaxed);
+            std::cout << "Depth " << static_cast<int>(thread.rootDepth) << ": score " << score_to_string(result.first) << ", " << nodes << " nodes, "
+                      << m_timeManager.elapsed() << " ms, hashfull " << m_transpositionTable.hashfull() << " permille, pv";
+            for (uint8_t i = 0; i < thread.previousPvLength; i++)
+                std::cout << " " << move_to_string(thread.previousPv[i]);
+            std::cout << std::endl;
+            if (m_timeManager.stopAfterIteration(result.second, result.first))
+                break;
+        }
+    }
+
+    if (thread.id == 0)
+        m_stop = true;
+}
+
 uint16_t Computer::getBestMove(BitBoard& board)
 {
-    uint16_t bookMove = m_openingBook.getMove(hash(board));
+    uint16_t bookMove = m_openingBook.getMove(board.m_key);
     if (bookMove != 0)
         return bookMove;
 
-    m_killerMoves.resize(m_depth, {0, 0});
-    uint16_t ret = negamax(board, m_depth, -std::numeric_limits<int>::max(), std::numeric_limits<int>::max(), board.player_to_move() == WHITE ? 1 : -1).second;
-    for (auto& entry : m_transpositionTable)
-        entry.second.age += 1;
-        
-    for (auto entry = m_transpositionTable.begin(); entry != m_transpositionTable.end();)
-        if (entry->second.age > 5)
-            entry = m_transpositionTable.erase(entry);
-        else
-            entry++;
+    // Nothing to think about with a single legal move
+    MoveList rootMoves;
+    board.get_moves(board.player_to_move(), rootMoves);
+    if (rootMoves.size() == 1)
+        return rootMoves[0];
+
+    if (m_timeControl.timeLeft != 0)
+        m_timeManager.start(m_timeControl);
+    else
+        m_timeManager.start(m_timeToPlay);
+    m_stop = false;
+    m_transpositionTable.newSearch();
+
+    m_threads.resize(std::max<uint8_t>(1, m_threadCount));
+    for (size_t i = 0; i < m_threads.size(); i++)
+    {
+        if (!m_threads[i])
+            m_threads[i] = std::make_unique<SearchThread>();
+        SearchThread& thread = *m_threads[i];
+        thread.id = i;
+        thread.boardStack[0] = board;
+        thread.keys = m_gameHistory;
+        thread.gamePly = m_gameHistory.size();
+        thread.keys.resize(thread.gamePly + MAX_PLY);
+        thread.nodes = 0;
+        thread.qnodes = 0;
+        thread.cutoffs = 0;
+        thread.firstMoveCutoffs = 0;
+        thread.rootDepth = 0;
+        thread.completedDepth = 0;
+        thread.bestMove = 0;
+        thread.bestScore = 0;
+        thread.previousPvLength = 0;
+        thread.stack.fill({ { 0, 0 }, 0, 0, 0 });
+        // History carries over from the previous search, halved so that the new position weighs more. Countermoves carry over as
+        // they are: each one is a single move, the next cutoff after the same move replaces it
+        for (auto& color : thread.history)
+            for (auto& from : color)
+                for (auto& entry : from)
+                    entry /= 2;
+    }
 
-    m_killerMoves.clear();
-    return ret;
+    std::vector<std::thread> helpers;
+    for (size_t i = 1; i < m_threads.size(); i++)
+        helpers.emplace_back(&Computer::iterativeDeepening, this, std::ref(*m_threads[i]));
+    iterativeDeepening(*m_threads[0]);
+    for (auto& helper : helpers)
+        helper.join();
+
+    // A helper that completed a deeper iteration than the main thread has the better move
+    SearchThread* best = m_threads[0].get();
+    for (auto& thread : m_threads)
+    {
+        m_nodes += thread->nodes;
+        m_qnodes += thread->qnodes;
+        m_cutoffs += thread->cutoffs;
+        m_firstMoveCutoffs += thread->firstMoveCutoffs;
+        if (thread->completedDepth > best->completedDepth && thread->bestMove != 0)
+            best = thread.get();
+    }
+    return best->bestMove;
+}
+
+/* Plays a move of the game on the board, keeping the positions it went through for the repetition detection of the next searches */
+void Computer::playMove(BitBoard& board, uint16_t move)
+{
+    m_gameHistory.push_back(board.m_key);
+    board.movePiece((move >> 6) & 0b111111, move & 0b111111, move >> 12);
+    // Nothing before a capture or a pawn move can come back
+    if (board.m_halfmove_clock == 0)
+        m_gameHistory.clear();
 }
@@ -0,0 +1,232 @@
+#include "MovePicker.h"
+#include "Computer.h"
+
+/* Most valuable victim first, least valuable attacker among equal victims: [victim][attacker] */
+constexpr std::array<std::array<int, 7>, 7> generate_mvv_lva()
+{
+    std::array<std::array<int, 7>, 7> table = {};
+    for (int victim = PAWN; victim <= KING; victim++)
+        for (int attacker = PAWN; attacker <= KING; attacker++)
+            table[victim][attacker] = PIECE_VALUES[victim] - PIECE_VALUES[attacker] / 10;
+    return table;
+}
+
+constexpr std::array<std::array<int, 7>, 7> MVV_LVA = generate_mvv_lva();
+
+/* Main search picker: TT move, good captures, killers and countermove, quiets by history then bad captures */
+MovePicker::MovePicker(const BitBoard& board, uint16_t ttMove, const std::array<uint16_t, 2>& killers, uint16_t counterMove, const HistoryTable& history)
+    : m_board(board), m_ttMove(ttMove), m_refutations({ killers[0], killers[1], counterMove }), m_history(&history),
+      m_capturesOnly(false), m_stage(TT_MOVE_STAGE), m_index(0)
+{
+    if (m_ttMove == 0 || !m_board.isLegal(m_ttMove))
+    {
+        m_ttMove = 0;
+        m_stage = GENERATE_CAPTURES_STAGE;
+    }
+}
+
+/* Quiescence picker: TT move if it is a capture, then the captures not losing material */
+MovePicker::MovePicker(const BitBoard& board, uint16_t ttMove)
+    : m_board(board), m_ttMove(ttMove), m_refutations({ 0, 0, 0 }), m_history(nullptr), m_capturesOnly(true), m_stage(TT_MOVE_STAGE), m_index(0)
+{
+    if (m_ttMove == 0 || !m_board.isCapture(m_ttMove) || !m_board.isLegal(m_ttMove))
+    {
+        m_ttMove = 0;
+        m_stage = GENERATE_CAPTURES_STAGE;
+    }
+}
+
+uint16_t MovePicker::next()
+{
+    switch (m_stage)
+    {
+    case TT_MOVE_STAGE:
+        m_stage = GENERATE_CAPTURES_STAGE;
+        return m_ttMove;
+
+    case GENERATE_CAPTURES_STAGE:
+        m_board.get_capture_moves(m_board.player_to_move(), m_moves);
+        scoreCaptures();
+        m_index = 0;
+        m_stage = GOOD_CAPTURES_STAGE;
+        [[fallthrough]];
+
+    case GOOD_CAPTURES_STAGE:
+        while (m_index < m_moves.size())
+        {
+            uint16_t move = pickBest();
+            if (move == m_ttMove)
+                continue;
+            if (isBadCapture(move))
+            {
+                m_badCaptures.push_back(move);
+                continue;
+            }
+            return move;
+        }
+        m_index = 0;
+        m_stage = m_capturesOnly ? DONE_STAGE : KILLERS_STAGE;
+        return next();
+
+    case KILLERS_STAGE:
+        while (m_index < m_refutations.size())
+        {
+            uint16_t refutation = m_refutations[m_index++];
+            auto previous = m_refutations.begin() + m_index - 1;
+            if (refutation == 0 || refutation == m_ttMove || std::find(m_refutations.begin(), previous, refutation) != previous)
+                continue;
+            if (!m_board.isCapture(refutation) && m_board.isLegal(refutation))
+                return refutation;
+        }
+        m_stage = GENERATE_QUIETS_STAGE;
+        [[fallthrough]];
+
+    case GENERATE_QUIETS_STAGE:
+        m_moves.clear();
+        m_board.get_quiet_moves(m_board.player_to_move(), m_moves);
+        scoreQuiets();
+        m_index = 0;
+        m_stage = QUIETS_STAGE;
+        [[fallthrough]];
+
+    case QUIETS_STAGE:
+        while (m_index < m_moves.size())
+        {
+            uint16_t move = pickBest();
+            if (move != m_ttMove && std::find(m_refutations.begin(), m_refutations.end(), move) == m_refutations.end())
+                return move;
+        }
+        m_index = 0;
+        m_stage = BAD_CAPTURES_STAGE;
+        [[fallthrough]];
+
+    case BAD_CAPTURES_STAGE:
+        if (m_index < m_badCaptures.size())
+            return m_badCaptures[m_index++];
+        m_stage = DONE_STAGE;
+        [[fallthrough]];
+
+    case DONE_STAGE:
+    default:
+        return 0;
+    }
+}
+
+/* MVV-LVA, with a bonus for taking back on the square the opponent just moved to */
+void MovePicker::scoreCaptures()
+{
+    for (size_t i = 0; i < m_moves.size(); i++)
+    {
+        uint8_t to = m_moves[i] & 0b111111;
+        uint8_t from = (m_moves[i] >> 6) & 0b111111;
+        uint8_t victim = m_board.at(to) ? m_board.at(to) : PAWN;
+        m_scores[i] = MVV_LVA[victim][m_board.at(from)] + (m_board.m_last_move_to == to) * 1001;
+    }
+}
+
+/* History of the move, the piece square value of the destination breaks the ties of moves never tried yet */
+void MovePicker::scoreQuiets()
+{
+    uint8_t player_to_move = m_board.player_to_move();
+    for (size_t i = 0; i < m_moves.size(); i++)
+    {
+        uint8_t to = m_moves[i] & 0b111111;
+        uint8_t from = (m_moves[i] >> 6) & 0b111111;
+        uint8_t square = (player_to_move == WHITE ? to : (7 - to / 8) * 8 + (to % 8));
+        m_scores[i] = (*m_history)[player_to_move][from][to] + PIECE_TABLES[m_board.at(from) - 1][square];
+    }
+}
+
+/* Selection sort step: brings the best remaining move to m_index and returns it, only sorting what gets searched */
+uint16_t MovePicker::pickBest()
+{
+    size_t best = m_index;
+    for (size_t i = m_index + 1; i < m_moves.size(); i++)
+        if (m_scores[i] > m_scores[best])
+            best = i;
+    std::swap(m_moves[best], m_moves[m_index]);
+    std::swap(m_scores[best], m_scores[m_index]);
+    return m_moves[m_index++];
+}
+
+/* A capture losing material once all the exchanges on its square are played, searched after the quiet moves */
+bool MovePicker::isBadCapture(uint16_t move) const
+{
+    uint8_t to = move & 0b111111;
+    uint8_t from = (move >> 6) & 0b111111;
+    uint8_t victim = m_board.at(to) ? m_board.at(to) : PAWN;
+    // Taking a piece worth at least the capturer never loses material, no need for the exchange
+    return PIECE_VALUES[victim] < PIECE_VALUES[m_board.at(from)] && see(m_board, move) < 0;
+}
+
+/* Least valuable piece of a color among the attackers, 0 if there is none */
+static uint8_t least_valuable_attacker(const BitBoard& board, uint64_t attackers, uint8_t color, uint64_t& bit)
+{
+    for (uint8_t piece = PAWN; piece <= KING; piece++)
+    {
+        uint64_t pieces = attackers & board.m_bitboards[color][piece];
+        if (pieces)
+        {
+            bit = pieces & -pieces;
+            return piece;
+        }
+    }
+    return 0;
+}
+
+/* Static exchange evaluation: material won by the side to move at the end of the sequence of captures on the
+   destination square, each side capturing with its least valuable piece and free to stop when it would lose.
+   Sliders behind a capturer join in as it leaves (x-rays). Pins are ignored */
+int see(const BitBoard& board, uint16_t move)
+{
+    uint8_t to = move & 0b111111;
+    uint8_t from = (move >> 6) & 0b111111;
+    uint8_t piece = board.at(from);
+    uint8_t color = board.player_to_move();
+
+    std::array<int, 32> gain;
+    int depth = 0;
+    uint64_t occupancy = board.allPieces();
+    if (piece == PAWN && to == board.m_en_passant_square)
+    {
+        occupancy ^= 1ULL << (to + (color == WHITE ? 8 : -8));
+        gain[0] = PIECE_VALUES[PAWN];
+    }
+    else
+        gain[0] = PIECE_VALUES[board.at(to)];
+    if (move >> 12)
+    {
+        gain[0] += PIECE_VALUES[move >> 12] - PIECE_VALUES[PAWN];
+        piece = move >> 12;
+    }
+
+    uint64_t bishops = board.m_bitboards[WHITE][BISHOP] | board.m_bitboards[BLACK][BISHOP] | board.m_bitboards[WHITE][QUEEN] | board.m_bitboards[BLACK][QUEEN];
+    uint64_t rooks = board.m_bitboards[WHITE][ROOK] | board.m_bitboards[BLACK][ROOK] | board.m_bitboards[WHITE][QUEEN] | board.m_bitboards[BLACK][QUEEN];
+    uint64_t attackers = board.attackersTo(to, occupancy);
+    uint64_t bit = 1ULL << from;
+    do
+    {
+        // Score if the opponent takes back the piece now standing on the square
+        depth++;
+        gain[depth] = PIECE_VALUES[piece] - gain[depth - 1];
+        if (std::max(-gain[depth - 1], gain[depth]) < 0)
+            break;
+
+        occupancy ^= bit;
+        if (piece == PAWN || piece == BISHOP || piece == QUEEN)
+            attackers |= board.get_bishop_moves(to, occupancy) & bishops;
+        if (piece == ROOK || piece == QUEEN)
+            attackers |= board.get_rook_moves(to, occupancy) & rooks;
+        attackers &= occupancy;
+
+        color = !color;
+        piece = least_valuable_attacker(board, attackers, color, bit);
+        // The king can only take back if nothing defends the square anymore
+        if (piece == KING && (attackers & board.m_bitboards[!color][ALL]))
+            piece = 0;
+    } while (piece && depth < 31);
+
+    while (--depth)
+        gain[depth - 1] = -std::max(-gain[depth - 1], gain[depth]);
+    return gain[0];
+}
@@ -0,0 +1,72 @@
+#include "TimeManager.h"
+
+TimeManager::TimeManager()
+{
+    start(0);
+}
+
+/* Game clock: share the remaining time between the moves to go, plus most of the increment */
+void TimeManager::start(const TimeControl& timeControl)
+{
+    reset();
+    m_fixed = false;
+
+    uint64_t available = timeControl.timeLeft > MOVE_OVERHEAD ? timeControl.timeLeft - MOVE_OVERHEAD : 1;
+    uint16_t movesToGo = timeControl.movesToGo != 0 ? std::min<uint16_t>(timeControl.movesToGo, 50) : DEFAULT_MOVES_TO_GO;
+
+    m_softLimit = available / movesToGo + timeControl.increment * 3 / 4;
+    // Never bet more than a fraction of the clock on one move, except for the last move before the time control
+    uint64_t maximum = movesToGo == 1 ? available * 9 / 10 : available * 2 / 5;
+    m_hardLimit = std::max<uint64_t>(1, std::min(m_softLimit * 5, maximum));
+    m_softLimit = std::max<uint64_t>(1, std::min(m_softLimit, m_hardLimit));
+}
+
+/* Fixed time per move, 0 for no limit: no stretching, the search runs until the deadline */
+void TimeManager::start(uint64_t moveTime)
+{
+    reset();
+    m_fixed = true;
+    m_softLimit = moveTime != 0 ? moveTime : std::numeric_limits<uint64_t>::max();
+    m_hardLimit = m_softLimit;
+}
+
+void TimeManager::reset()
+{
+    m_start = std::chrono::steady_clock::now();
+    m_bestMove = 0;
+    m_score = 0;
+    m_stableIterations = 0;
+    m_instability = 0;
+}
+
+uint64_t TimeManager::elapsed() const
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_start).count();
+}
+
+bool TimeManager::hardLimitReached() const
+{
+    return elapsed() >= m_hardLimit;
+}
+
+/* Called after each complete iteration with its result, tells whether to play now instead of going one depth deeper */
+bool TimeManager::stopAfterIteration(uint16_t bestMove, int score)
+{
+    if (m_fixed)
+        return hardLimitReached();
+
+    // A best move that keeps changing needs more time, one that stays put for several iterations dominates
+    bool changed = m_bestMove != 0 && bestMove != m_bestMove;
+    m_instability = m_instability / 2 + (changed ? 1 : 0);
+    m_stableIterations = changed ? 0 : m_stableIterations + 1;
+    bool scoreDropped = m_bestMove != 0 && score < m_score - 30;
+    m_bestMove = bestMove;
+    m_score = score;
+
+    double scale = (1 + m_instability) * (scoreDropped ? 1.5 : 1.0) * (m_stableIterations >= 4 ? 0.5 : 1.0);
+    uint64_t limit = std::min<uint64_t>(m_hardLimit, m_softLimit * scale);
+
+    // The next iteration takes a few times longer than all the previous ones together, starting it past
+    // 60% of the limit would mostly end aborted at the hard limit
+    return elapsed() >= limit * 6 / 10;
+}
@@ -0,0 +1,151 @@
+#include "TranspositionTable.h"
+
+constexpr uint8_t GENERATION_MASK = 0b111111;
+
+static inline uint16_t data_move(uint64_t data) { return data & 0xFFFF; }
+static inline int16_t data_score(uint64_t data) { return static_cast<int16_t>((data >> 16) & 0xFFFF); }
+static inline bool data_empty(uint64_t data) { return ((data >> 32) & 0xFF) == 0; }
+static inline uint8_t data_depth(uint64_t data) { return ((data >> 32) & 0xFF) - 1; }
+static inline uint8_t data_type(uint64_t data) { return (data >> 40) & 0b11; }
+static inline uint8_t data_generation(uint64_t data) { return (data >> 42) & GENERATION_MASK; }
+
+TranspositionTable::TranspositionTable(size_t megabytes) : m_mask(0), m_generation(0)
+{
+    resize(megabytes);
+}
+
+TranspositionTable::TranspositionTable(const TranspositionTable& other) : m_mask(0), m_generation(0)
+{
+    *this = other;
+}
+
+TranspositionTable& TranspositionTable::operator=(const TranspositionTable& other)
+{
+    if (this == &other)
+        return *this;
+    m_buckets.reset(new TranspositionTableBucket[other.m_mask + 1]);
+    m_mask = other.m_mask;
+    m_generation = other.m_generation;
+    for (size_t i = 0; i <= m_mask; i++)
+    {
+        for (size_t j = 0; j < TT_BUCKET_SIZE; j++)
+        {
+            m_buckets[i].entries[j].key_xor_data.store(other.m_buckets[i].entries[j].key_xor_data.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            m_buckets[i].entries[j].data.store(other.m_buckets[i].entries[j].data.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+    }
+    return *this;
+}
+
+void TranspositionTable::resize(size_t megabytes)
+{
+    size_t buckets = std::max<size_t>(1, megabytes * 1024 * 1024 / sizeof(TranspositionTableBucket));
+    while (buckets & (buckets - 1))
+        buckets &= buckets - 1;
+    m_buckets.reset(new TranspositionTableBucket[buckets]);
+    m_mask = buckets - 1;
+    clear();
+}
+
+/* Not thread safe, only called between searches */
+void TranspositionTable::clear()
+{
+    std::memset(static_cast<void*>(m_buckets.get()), 0, size() * sizeof(TranspositionTableEntry));
+    m_generation = 0;
+}
+
+/* Called before every search, entries of the previous ones become the first to be replaced */
+void TranspositionTable::newSearch()
+{
+    m_generation = (m_generation + 1) & GENERATION_MASK;
+}
+
+bool TranspositionTable::probe(uint64_t key, TranspositionTableData& data) const
+{
+    const TranspositionTableBucket& bucket = m_buckets[key & m_mask];
+    for (const auto& entry : bucket.entries)
+    {
+        uint64_t entryData = entry.data.load(std::memory_order_relaxed);
+        if ((entry.key_xor_data.load(std::memory_order_relaxed) ^ entryData) == key && !data_empty(entryData))
+        {
+            data = { data_move(entryData), data_depth(entryData), data_score(entryData), static_cast<TranspositionTableNodeType>(data_type(entryData)) };
+            return true;
+        }
+    }
+    return false;
+}
+
+void TranspositionTable::store(uint64_t key, uint16_t move, uint8_t depth, int score, TranspositionTableNodeType type)
+{
+    TranspositionTableBucket& bucket = m_buckets[key & m_mask];
+
+    // Same position: keep the deeper result unless it comes from an older search
+    TranspositionTableEntry* replace = nullptr;
+    for (auto& entry : bucket.entries)
+    {
+        uint64_t entryData = entry.data.load(std::memory_order_relaxed);
+        if ((entry.key_xor_data.load(std::memory_order_relaxed) ^ entryData) == key && !data_empty(entryData))
+        {
+            if (depth < data_depth(entryData) && age(entryData) == 0)
+                return;
+            if (move == 0)
+                move = data_move(entryData);
+            replace = &entry;
+            break;
+        }
+    }
+
+    // Otherwise an empty slot, or the shallowest entry, counting each search of age as 8 plies of depth
+    if (replace == nullptr)
+    {
+        int replaceValue = std::numeric_limits<int>::max();
+        for (auto& entry : bucket.entries)
+        {
+            uint64_t entryData = entry.data.load(std::memory_order_relaxed);
+            if (data_empty(entryData))
+            {
+                replace = &entry;
+                break;
+            }
+            int value = data_depth(entryData) - 8 * age(entryData);
+            if (value < replaceValue)
+            {
+                replace = &entry;
+                replaceValue = value;
+            }
+        }
+    }
+
+    uint64_t data = move | (static_cast<uint64_t>(static_cast<uint16_t>(std::clamp(score, -32767, 32767))) << 16)
+                  | (static_cast<uint64_t>(depth + 1) << 32) | (static_cast<uint64_t>(type) << 40) | (static_cast<uint64_t>(m_generation) << 42);
+    replace->key_xor_data.store(key ^ data, std::memory_order_relaxed);
+    replace->data.store(data, std::memory_order_relaxed);
+}
+
+/* Number of entries the table can hold */
+size_t TranspositionTable::size() const
+{
+    return (m_mask + 1) * TT_BUCKET_SIZE;
+}
+
+/* Permille of the table filled by the current search, estimated on the first thousand entries */
+int TranspositionTable::hashfull() const
+{
+    size_t buckets = std::min<size_t>(m_mask + 1, 1000 / TT_BUCKET_SIZE);
+    int used = 0;
+    for (size_t i = 0; i < buckets; i++)
+    {
+        for (const auto& entry : m_buckets[i].entries)
+        {
+            uint64_t data = entry.data.load(std::memory_order_relaxed);
+            used += (!data_empty(data) && age(data) == 0);
+        }
+    }
+    return used * 1000 / static_cast<int>(buckets * TT_BUCKET_SIZE);
+}
+
+/* How many searches ago an entry was written */
+uint8_t TranspositionTable::age(uint64_t data) const
+{
+    return (m_generation - data_generation(data)) & GENERATION_MASK;
+}
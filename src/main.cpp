@@ -4,9 +4,33 @@
 #include "BitBoardState.h"
 #endif
 
+#ifdef CHESS_COUNT_ALLOCATIONS
+// Counts every heap allocation of the program, for allocationBenchmark
+static uint64_t allocations = 0;
+
+void* operator new(size_t size)
+{
+    allocations++;
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+#endif
+
 int64_t perft_count(BitBoard& bitBoard, int depth)
 {
-    auto moves = bitBoard.get_moves(bitBoard.player_to_move());
+    MoveList moves;
+    bitBoard.get_moves(bitBoard.player_to_move(), moves);
     int64_t count = 0;
     for (auto move : moves)
     {
@@ -25,6 +49,41 @@ int64_t perft_count(BitBoard& bitBoard, int depth)
     return count;
 }
 
+/* Same count as perft_count, but every move is played on a copy of the board instead of being undone */
+int64_t perft_count_copy(const BitBoard& bitBoard, int depth)
+{
+    MoveList moves;
+    bitBoard.get_moves(bitBoard.player_to_move(), moves);
+    int64_t count = 0;
+    for (auto move : moves)
+    {
+        BitBoard child = bitBoard;
+        child.movePiece((move >> 6) & 0b111111, move & 0b111111, move >> 12);
+        if (depth == 1)
+            count++;
+        else
+            count += perft_count_copy(child, depth - 1);
+    }
+    return count;
+}
+
+/* Same count as perft_count, through the std::vector generator that allocates at every node */
+int64_t perft_count_vector(BitBoard& bitBoard, int depth)
+{
+    auto moves = bitBoard.get_moves(bitBoard.player_to_move());
+    int64_t count = 0;
+    for (auto move : moves)
+    {
+        uint64_t encodedMove = bitBoard.movePiece((move >> 6) & 0b111111, move & 0b111111, move >> 12);
+        if (depth == 1)
+            count++;
+        else
+            count += perft_count_vector(bitBoard, depth - 1);
+        bitBoard.undoMove(encodedMove);
+    }
+    return count;
+}
+
 int64_t perft(BitBoard& bitBoard, int depth)
 {
     int total = 0;
@@ -94,7 +153,7 @@ void computer_play()
         auto end = high_resolution_clock::now();
         auto duration = duration_cast<milliseconds>(end - start);
         std::cout << "Move: " << move << " in " << duration.count() << " milliseconds" << std::endl;
-        bitboard.movePiece(move >> 6, move & 0b111111, move >> 12);
+        computer.playMove(bitboard, move);
         std::cout << bitboard;
         int from_x = 0;
         int from_y = 0;
@@ -128,11 +187,151 @@ void computer_play()
                 }
             }
         } while (!bitboard.occupied(from_x + from_y * 8));
-        bitboard.movePiece(from_y * 8 + from_x, to_y * 8 + to_x, promotion);
+        computer.playMove(bitboard, (to_y * 8 + to_x) | ((from_y * 8 + from_x) << 6) | (promotion << 12));
         std::cout << bitboard;
     }
 }
 
+constexpr uint8_t SEARCH_BENCH_DEPTH = 6;
+constexpr uint8_t TACTICS_DEPTH = 7;
+constexpr uint8_t MATE_BENCH_DEPTH = 10;
+
+const std::vector<std::string> BENCH_POSITIONS = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+    "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+};
+
+/* Searches each position to the computer's depth on an empty table, and returns the nodes searched and the milliseconds it took.
+   With verbose, prints the move found and the nodes of each position */
+std::pair<uint64_t, int64_t> runSearch(Computer& computer, const std::vector<std::string>& positions, bool verbose = false)
+{
+    using namespace std::chrono;
+    computer.m_timeToPlay = 0;
+    uint64_t startNodes = computer.m_nodes;
+    auto start = high_resolution_clock::now();
+    for (auto& fen : positions)
+    {
+        BitBoard bitboard(fen);
+        computer.m_transpositionTable.clear();
+        uint64_t nodes = computer.m_nodes;
+        uint16_t move = computer.getBestMove(bitboard);
+        if (verbose)
+            std::cout << fen << ": " << move_to_string(move) << ", " << computer.m_nodes - nodes << " nodes" << std::endl;
+    }
+    int64_t duration = std::max<int64_t>(1, duration_cast<milliseconds>(high_resolution_clock::now() - start).count());
+    return std::make_pair(computer.m_nodes - startNodes, duration);
+}
+
+/* Compares make/unmake with copy-make, in perft and in search, in nodes per second */
+void copyMakeBenchmark()
+{
+    using namespace std::chrono;
+    std::cout << "sizeof(BitBoard): " << sizeof(BitBoard) << " bytes" << std::endl;
+
+    for (bool copyMake : { false, true })
+    {
+        int64_t nodes = 0;
+        auto start = high_resolution_clock::now();
+        for (auto& fen : BENCH_POSITIONS)
+        {
+            BitBoard bitboard(fen);
+            nodes += copyMake ? perft_count_copy(bitboard, 4) : perft_count(bitboard, 4);
+        }
+        auto duration = duration_cast<milliseconds>(high_resolution_clock::now() - start).count();
+        std::cout << (copyMake ? "Perft copy-make:   " : "Perft make/unmake: ") << nodes << " nodes in " << duration << " ms, "
+                  << nodes * 1000 / std::max<int64_t>(duration, 1) << " nps" << std::endl;
+    }
+
+    for (bool copyMake : { false, true })
+    {
+        Computer computer(5, "");
+        computer.m_copyMake = copyMake;
+        auto [nodes, duration] = runSearch(computer, BENCH_POSITIONS);
+        std::cout << (copyMake ? "Search copy-make:   " : "Search make/unmake: ") << nodes << " nodes in " << duration << " ms, "
+                  << nodes * 1000 / duration << " nps" << std::endl;
+    }
+}
+
+/* Nodes and time to search the bench positions to a fixed depth, the reference for search changes */
+void searchBenchmark()
+{
+    Computer computer(SEARCH_BENCH_DEPTH, "");
+    auto [nodes, duration] = runSearch(computer, BENCH_POSITIONS, true);
+    std::cout << "Search depth " << static_cast<int>(SEARCH_BENCH_DEPTH) << ": " << nodes << " nodes in " << duration << " ms, "
+              << nodes * 1000 / duration << " nps" << std::endl;
+    std::cout << "Quiescence nodes: " << 100.0 * computer.m_qnodes / std::max<uint64_t>(computer.m_nodes, 1) << "%" << std::endl;
+    std::cout << "First move cutoffs: " << 100.0 * computer.m_firstMoveCutoffs / std::max<uint64_t>(computer.m_cutoffs, 1) << "% of "
+              << computer.m_cutoffs << " cutoffs" << std::endl;
+}
+
+/* Nodes to search positions with a forced mate to a fixed depth, and the best move found */
+void mateBenchmark()
+{
+    const std::vector<std::string> positions = {
+        "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+        "r5rk/5p1p/5R2/4B3/8/8/7P/7K w - - 0 1",
+        "r1b1kb1r/pppp1ppp/5q2/4n3/3KP3/2N3PN/PPP4P/R1BQ1B1R b kq - 0 1",
+        "r1bq2rk/pp3pbp/2p1p1pQ/7P/3P4/2PB1N2/PP3PP1/R3K2R w KQ - 0 1",
+        "2rr3k/pp3pp1/1nnqbN1p/3pN3/2pP4/2P3Q1/PPB4P/R4RK1 w - - 0 1",
+        "r2qkb1r/pp2nppp/3p4/2pNN1B1/2BnP3/3P4/PPP2PPP/R2bK2R w KQkq - 1 1",
+    };
+
+    Computer computer(MATE_BENCH_DEPTH, "");
+    uint64_t nodes = runSearch(computer, positions, true).first;
+    std::cout << "Mates depth " << static_cast<int>(MATE_BENCH_DEPTH) << ": " << nodes << " nodes" << std::endl;
+}
+
+/* Lazy SMP scaling: nodes per second and time to reach the same depth on the bench positions for each thread count */
+void threadsBenchmark()
+{
+    std::cout << "Hardware threads: " << std::thread::hardware_concurrency() << std::endl;
+
+    int64_t baseDuration = 0;
+    for (uint8_t threads : { 1, 2, 4, 8, 16 })
+    {
+        Computer computer(6, "");
+        computer.m_threadCount = threads;
+        auto [nodes, duration] = runSearch(computer, BENCH_POSITIONS);
+        if (threads == 1)
+            baseDuration = duration;
+        std::cout << static_cast<int>(threads) << " threads: " << nodes << " nodes in " << duration << " ms, "
+                  << nodes * 1000 / duration << " nps, time to depth x" << static_cast<double>(baseDuration) / duration << std::endl;
+    }
+}
+
+/* Heap allocations per node of perft with the std::vector and the MoveList generators, and of the search */
+void allocationBenchmark()
+{
+#ifdef CHESS_COUNT_ALLOCATIONS
+    for (bool moveList : { false, true })
+    {
+        int64_t nodes = 0;
+        uint64_t start = allocations;
+        for (auto& fen : BENCH_POSITIONS)
+        {
+            BitBoard bitboard(fen);
+            nodes += moveList ? perft_count(bitboard, 3) : perft_count_vector(bitboard, 3);
+        }
+        std::cout << (moveList ? "Perft MoveList:    " : "Perft std::vector: ") << (allocations - start) << " allocations for " << nodes << " nodes, "
+                  << (allocations - start) / static_cast<double>(nodes) << " per node" << std::endl;
+    }
+
+    Computer computer(4, "");
+    uint64_t start = allocations;
+    uint64_t nodes = runSearch(computer, BENCH_POSITIONS).first;
+    std::cout << "Search: " << (allocations - start) << " allocations for " << nodes << " nodes, "
+              << (allocations - start) / static_cast<double>(nodes) << " per node" << std::endl;
+#else
+    std::cout << "Build with -DCHESS_COUNT_ALLOCATIONS to count allocations" << std::endl;
+#endif
+}
+
 void hashTest()
 {
     std::map<std::string, std::string> tests = {
@@ -149,27 +348,165 @@ void hashTest()
 
     Computer computer;
     int ok = 0;
-    for (auto& test : tests)
+    int total = 0;
+    auto check = [&](const std::string& name, uint64_t key, const std::string& expected)
     {
-        BitBoard board(test.first);
-        std::cout << "Testing FEN: " << test.first;
         std::stringstream ss;
-        ss << std::hex << computer.hash(board);
+        ss << std::hex << key;
         std::string hashed = ss.str();
-        if (hashed == test.second)
+        total++;
+        if (hashed == expected)
         {
-            std::cout << ": OK" << std::endl;
+            std::cout << name << ": OK" << std::endl;
             ok++;
         }
         else
-            std::cout << ": KO \n  Got: " << std::hex << hashed << "\n  Expected: " << test.second << std::dec << std::endl;
+            std::cout << name << ": KO \n  Got: " << hashed << "\n  Expected: " << expected << std::endl;
+    };
+
+    for (auto& test : tests)
+    {
+        BitBoard board(test.first);
+        check("Testing FEN: " + test.first, computer.hash(board), test.second);
+        check("Testing FEN key: " + test.first, board.m_key, test.second);
+    }
+
+    // The same positions reached by playing the moves, the key is then only updated incrementally
+    std::vector<std::vector<std::pair<std::string, std::string>>> games = {
+        { { "e2e4", "823c9b50fd114196" }, { "d7d5", "756b94461c50fb0" }, { "e4e5", "662fafb965db29d4" },
+          { "f7f5", "22a48b5a8e47ff78" }, { "e1e2", "652a607ca3f242c1" }, { "e8f7", "fdd303c946bdd9" } },
+        { { "a2a4", "" }, { "b7b5", "" }, { "h2h4", "" }, { "b5b4", "" }, { "c2c4", "3c8123ea7b067637" },
+          { "b4c3", "" }, { "a1a3", "5c3f9b829b279560" } },
+    };
+    for (auto& game : games)
+    {
+        BitBoard board("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+        std::vector<uint64_t> history;
+        std::string played;
+        for (auto& move : game)
+        {
+            int8_t from = (move.first[0] - 'a') + (8 - (move.first[1] - '0')) * 8;
+            int8_t to = (move.first[2] - 'a') + (8 - (move.first[3] - '0')) * 8;
+            history.push_back(board.movePiece(from, to, 0));
+            played += (played.empty() ? "" : " ") + move.first;
+            if (!move.second.empty())
+                check("Testing moves: " + played, board.m_key, move.second);
+        }
+        while (!history.empty())
+        {
+            board.undoMove(history.back());
+            history.pop_back();
+        }
+        check("Testing undo: " + played, board.m_key, "463b96181691fc9c");
     }
 
+    std::cout << "OK: " << ok << "/" << total << std::endl;
+}
+
+/* Mates and combinations from Win at Chess the search must find at a fixed depth, run after any pruning change */
+void tacticsTest()
+{
+    std::vector<std::pair<std::string, std::string>> tests = {
+        { "r1bqkb1r/pppp1ppp/2n2n2/4p2Q/2B1P3/8/PPPP1PPP/RNB1K1NR w KQkq - 4 4", "h5f7" },
+        { "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1", "d1d8" },
+        { "2rr3k/pp3pp1/1nnqbN1p/3pN3/2pP4/2P3Q1/PPB4P/R4RK1 w - - 0 1", "g3g6" },
+        { "5rk1/1ppb3p/p1pb4/6q1/3P1p1r/2P1R2P/PP1BQ1P1/5RKN w - - 0 1", "e3g3" },
+        { "r1bq2rk/pp3pbp/2p1p1pQ/7P/3P4/2PB1N2/PP3PP1/R3K2R w KQ - 0 1", "h6h7" },
+        { "5k2/6pp/p1qN4/1p1p4/3P4/2PKP2Q/PP3r2/3R4 b - - 0 1", "c6c4" },
+        { "7k/p7/1R5K/6r1/6p1/6P1/8/8 w - - 0 1", "b6b7" },
+        { "rnbqkb1r/pppp1ppp/8/4P3/6n1/7P/PPPNPPP1/R1BQKBNR b KQkq - 0 1", "g4e3" },
+        { "r4q1k/p2bR1rp/2p2Q1N/5p2/5p2/2P5/PP3PPP/R5K1 w - - 0 1", "e7f7" },
+        { "3q1rk1/p4pp1/2pb3p/3p4/6Pr/1PNQ4/P1PB1PP1/4RRK1 b - - 0 1", "d6h2" },
+        { "2br2k1/2q3rn/p2NppQ1/2p1P3/Pp5R/4P3/1P3PPP/3R2K1 w - - 0 1", "h4h7" },
+    };
+
+    Computer computer(TACTICS_DEPTH, "");
+    computer.m_timeToPlay = 0;
+    int ok = 0;
+    for (auto& test : tests)
+    {
+        BitBoard board(test.first);
+        computer.m_transpositionTable.clear();
+        std::string found = move_to_string(computer.getBestMove(board));
+        if (found == test.second)
+        {
+            std::cout << test.first << ": OK" << std::endl;
+            ok++;
+        }
+        else
+            std::cout << test.first << ": KO \n  Got: " << found << "\n  Expected: " << test.second << std::endl;
+    }
     std::cout << "OK: " << ok << "/" << tests.size() << std::endl;
 }
 
-int main()
+/* Perft over the bench positions must give the same counts with every slider attack backend the CPU supports */
+void sliderBackendTest()
 {
+    using namespace std::chrono;
+    SliderBackend startBackend = slider_backend;
+    std::vector<int64_t> expected;
+    int ok = 0;
+    int total = 0;
+
+    for (SliderBackend backend : { MAGIC_BACKEND, PEXT_BACKEND })
+    {
+        std::string name = backend == MAGIC_BACKEND ? "magic" : "pext";
+        if (!set_slider_backend(backend))
+        {
+            std::cout << "Backend " << name << ": not supported by this CPU" << std::endl;
+            continue;
+        }
+        int64_t nodes = 0;
+        auto start = high_resolution_clock::now();
+        for (size_t i = 0; i < BENCH_POSITIONS.size(); i++)
+        {
+            BitBoard bitboard(BENCH_POSITIONS[i]);
+            int64_t count = perft_count(bitboard, 4);
+            nodes += count;
+            if (expected.size() <= i)
+                expected.push_back(count);
+            total++;
+            if (count == expected[i])
+                ok++;
+            else
+                std::cout << "Backend " << name << ": KO on " << BENCH_POSITIONS[i] << "\n  Got: " << count << "\n  Expected: " << expected[i] << std::endl;
+        }
+        auto duration = duration_cast<milliseconds>(high_resolution_clock::now() - start).count();
+        std::cout << "Backend " << name << ": " << nodes << " nodes in " << duration << " ms, " << nodes * 1000 / std::max<int64_t>(duration, 1) << " nps" << std::endl;
+    }
+
+    set_slider_backend(startBackend);
+    std::cout << "OK: " << ok << "/" << total << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1 && std::string(argv[1]) == "test")
+    {
+        std::map<std::string, void (*)()> tests = {
+            { "hash", hashTest },
+            { "backends", sliderBackendTest },
+            { "tactics", tacticsTest },
+        };
+        for (auto& test : tests)
+            if (argc == 2 || test.first == argv[2])
+                test.second();
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "bench")
+    {
+        std::map<std::string, void (*)()> benchmarks = {
+            { "search", searchBenchmark },
+            { "copymake", copyMakeBenchmark },
+            { "alloc", allocationBenchmark },
+            { "threads", threadsBenchmark },
+            { "mate", mateBenchmark },
+        };
+        for (auto& benchmark : benchmarks)
+            if (argc == 2 || benchmark.first == argv[2])
+                benchmark.second();
+        return 0;
+    }
 
 #ifdef CHESS_GUI
     sf::RenderWindow window(sf::VideoMode(800, 800), "Chess");